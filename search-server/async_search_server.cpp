@@ -0,0 +1,72 @@
+#include "async_search_server.h"
+
+using namespace std;
+
+
+AsyncSearchServer::AsyncSearchServer(const SearchServer& search_server, size_t thread_count)
+    : search_server_(search_server) {
+    thread_count = max<size_t>(thread_count, 1);
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back([this] { RunWorker(); });
+    }
+}
+
+AsyncSearchServer::~AsyncSearchServer() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+future<AsyncSearchResult> AsyncSearchServer::FindTopDocuments(string raw_query, Clock::time_point deadline,
+                                                              CancellationToken token, DocumentStatus status,
+                                                              size_t max_result_count) {
+    packaged_task<AsyncSearchResult()> task([this, raw_query = move(raw_query), deadline, token = move(token),
+                                             status, max_result_count] {
+        SearchControl control(deadline, token);
+        AsyncSearchResult result;
+        result.documents = search_server_.FindTopDocuments(raw_query, status, max_result_count, control);
+        result.status = control.GetStatus();
+        return result;
+    });
+    future<AsyncSearchResult> result = task.get_future();
+    {
+        lock_guard guard(mutex_);
+        tasks_.push_back(move(task));
+    }
+    condition_.notify_one();
+    return result;
+}
+
+future<AsyncSearchResult> AsyncSearchServer::FindTopDocuments(string raw_query, Clock::duration timeout,
+                                                              CancellationToken token, DocumentStatus status,
+                                                              size_t max_result_count) {
+    return FindTopDocuments(move(raw_query), Clock::now() + timeout, move(token), status, max_result_count);
+}
+
+size_t AsyncSearchServer::GetQueueSize() const {
+    lock_guard guard(mutex_);
+    return tasks_.size();
+}
+
+void AsyncSearchServer::RunWorker() {
+    unique_lock lock(mutex_);
+    while (true) {
+        condition_.wait(lock, [this] {
+            return stopping_ || !tasks_.empty();
+        });
+        if (tasks_.empty()) {
+            return;
+        }
+        packaged_task<AsyncSearchResult()> task = move(tasks_.front());
+        tasks_.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "document.h"
+#include "search_control.h"
+#include "search_server.h"
+
+
+struct AsyncSearchResult {
+    SearchStatus status = SearchStatus::COMPLETED;
+    // On a timeout or cancellation, the best of the documents scored before
+    // the search stopped; empty if it never started
+    std::vector<Document> documents;
+};
+
+
+// Runs searches on a SearchServer from its own worker threads, so that the
+// caller never blocks. The server must outlive this object and must not be
+// modified while searches are queued or running.
+//
+// The destructor lets queued searches finish; cancel their tokens to drop them quickly.
+class AsyncSearchServer {
+public:
+    using Clock = SearchControl::Clock;
+
+    explicit AsyncSearchServer(const SearchServer& search_server,
+                               size_t thread_count = std::thread::hardware_concurrency());
+    ~AsyncSearchServer();
+
+    AsyncSearchServer(const AsyncSearchServer&) = delete;
+    AsyncSearchServer& operator=(const AsyncSearchServer&) = delete;
+
+    // The deadline covers the time spent in the queue as well. Errors of the
+    // query, such as an invalid word, are thrown from the future
+    std::future<AsyncSearchResult> FindTopDocuments(std::string raw_query, Clock::time_point deadline,
+                                                    CancellationToken token = {},
+                                                    DocumentStatus status = DocumentStatus::ACTUAL,
+                                                    size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT);
+    std::future<AsyncSearchResult> FindTopDocuments(std::string raw_query, Clock::duration timeout,
+                                                    CancellationToken token = {},
+                                                    DocumentStatus status = DocumentStatus::ACTUAL,
+                                                    size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT);
+
+    // Searches submitted but not yet picked up by a worker
+    size_t GetQueueSize() const;
+
+private:
+    const SearchServer& search_server_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::packaged_task<AsyncSearchResult()>> tasks_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+
+    void RunWorker();
+};
@@ -0,0 +1,351 @@
+#include "corpus_generator.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Measures the main SearchServer operations on a synthetic corpus and prints
+// the results as one JSON object to stdout.
+//
+// Usage: search_benchmark [--option=value ...], options as in BenchmarkConfig,
+// e.g. search_benchmark --documents=1000000 --zipf=1.1
+
+struct BenchmarkConfig {
+    int documents = 10'000;
+    int dictionary = 20'000;
+    int words_per_document = 50;
+    int queries = 1'000;
+    int words_per_query = 5;
+    double minus_prob = 0.1;
+    // Exponent of the word frequency distribution; 0 draws words uniformly
+    double zipf = 1.0;
+    // Share of documents that repeat the text of a recent one, for RemoveDuplicates
+    double duplicates = 0.01;
+    int removals = 1'000;
+    // Runs of the whole query batch through ProcessQueries
+    int batch_runs = 5;
+    unsigned seed = 0;
+    // Also records and prints the per-stage query stats, at some cost in speed
+    bool query_stats = false;
+};
+
+BenchmarkConfig ParseConfig(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    for (int i = 1; i < argc; ++i) {
+        const string_view arg = argv[i];
+        const size_t equals = arg.find('=');
+        if (arg.substr(0, 2) != "--"sv || equals == arg.npos) {
+            throw invalid_argument("Expected --option=value, got "s + string(arg));
+        }
+        const string_view name = arg.substr(2, equals - 2);
+        const string value(arg.substr(equals + 1));
+        if (name == "documents"sv) {
+            config.documents = stoi(value);
+        } else if (name == "dictionary"sv) {
+            config.dictionary = stoi(value);
+        } else if (name == "words_per_document"sv) {
+            config.words_per_document = stoi(value);
+        } else if (name == "queries"sv) {
+            config.queries = stoi(value);
+        } else if (name == "words_per_query"sv) {
+            config.words_per_query = stoi(value);
+        } else if (name == "minus_prob"sv) {
+            config.minus_prob = stod(value);
+        } else if (name == "zipf"sv) {
+            config.zipf = stod(value);
+        } else if (name == "duplicates"sv) {
+            config.duplicates = stod(value);
+        } else if (name == "removals"sv) {
+            config.removals = stoi(value);
+        } else if (name == "batch_runs"sv) {
+            config.batch_runs = stoi(value);
+        } else if (name == "seed"sv) {
+            config.seed = static_cast<unsigned>(stoul(value));
+        } else if (name == "query_stats"sv) {
+            config.query_stats = stoi(value) != 0;
+        } else {
+            throw invalid_argument("Unknown option "s + string(name));
+        }
+    }
+    if (config.documents <= 0 || config.dictionary <= 0 || config.words_per_document <= 0
+        || config.queries <= 0 || config.words_per_query <= 0 || config.batch_runs <= 0) {
+        throw invalid_argument("Sizes must be positive"s);
+    }
+    return config;
+}
+
+
+using Clock = chrono::steady_clock;
+
+// Latencies of one kind of operation
+class Measurement {
+public:
+    // Every operation handles items_per_operation items, e.g. queries of a batch
+    explicit Measurement(string name, size_t items_per_operation = 1)
+        : name_(move(name))
+        , items_per_operation_(items_per_operation) {
+    }
+
+    template <typename Operation>
+    void Run(Operation operation) {
+        const auto start = Clock::now();
+        operation();
+        latencies_.push_back(Clock::now() - start);
+    }
+
+    void PrintJson(ostream& out) {
+        sort(latencies_.begin(), latencies_.end());
+        Clock::duration total{};
+        for (const Clock::duration latency : latencies_) {
+            total += latency;
+        }
+        const double total_seconds = chrono::duration<double>(total).count();
+        const double items = static_cast<double>(latencies_.size() * items_per_operation_);
+        out << "{\"name\": \""s << name_ << "\", \"operations\": "s << latencies_.size()
+            << ", \"items\": "s << latencies_.size() * items_per_operation_
+            << ", \"total_ms\": "s << total_seconds * 1e3
+            << ", \"items_per_second\": "s << (total_seconds > 0 ? items / total_seconds : 0.0)
+            << ", \"p50_us\": "s << GetPercentile(0.5)
+            << ", \"p99_us\": "s << GetPercentile(0.99)
+            << ", \"p999_us\": "s << GetPercentile(0.999) << '}';
+    }
+
+private:
+    string name_;
+    size_t items_per_operation_;
+    vector<Clock::duration> latencies_;
+
+    // Nearest-rank percentile in microseconds; requires sorted latencies
+    double GetPercentile(double fraction) const {
+        if (latencies_.empty()) {
+            return 0.0;
+        }
+        const size_t rank = static_cast<size_t>(ceil(fraction * latencies_.size()));
+        const Clock::duration latency = latencies_[max<size_t>(rank, 1) - 1];
+        return chrono::duration<double, micro>(latency).count();
+    }
+};
+
+
+// Results are summed here, so that no measured call can be optimized away
+double checksum = 0.0;
+
+void AddChecksum(const vector<Document>& documents) {
+    for (const Document& document : documents) {
+        checksum += document.relevance;
+    }
+}
+
+void PrintQueryStatsJson(ostream& out, const QueryStatsSnapshot& stats) {
+    static const char* const stage_names[QUERY_STAGE_COUNT] = {
+        "parse", "posting_traversal", "minus_filter", "top_k", "materialize"};
+    static const char* const counter_names[QUERY_COUNTER_COUNT] = {
+        "postings_scanned", "documents_scored", "documents_filtered"};
+    out << "{\"stages\": ["s;
+    for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+        const LatencyHistogram& latencies = stats.stages[stage];
+        out << (stage > 0 ? ", "s : ""s) << "{\"name\": \""s << stage_names[stage]
+            << "\", \"count\": "s << latencies.GetCount()
+            << ", \"total_ns\": "s << latencies.GetTotal()
+            << ", \"p50_ns\": "s << latencies.GetPercentile(0.5)
+            << ", \"p99_ns\": "s << latencies.GetPercentile(0.99)
+            << ", \"p999_ns\": "s << latencies.GetPercentile(0.999) << '}';
+    }
+    out << "], \"counters\": {"s;
+    for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+        out << (counter > 0 ? ", "s : ""s) << '"' << counter_names[counter] << "\": "s << stats.counters[counter];
+    }
+    out << "}}"s;
+}
+
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    try {
+        config = ParseConfig(argc, argv);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    mt19937 generator(config.seed);
+    const vector<string> dictionary = GenerateDictionary(generator, config.dictionary, 10);
+    const ZipfDistribution distribution(dictionary.size(), config.zipf);
+    vector<string> queries;
+    queries.reserve(config.queries);
+    for (int i = 0; i < config.queries; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, distribution, config.words_per_query, config.minus_prob));
+    }
+
+    vector<Measurement> measurements;
+
+    // Texts are generated one at a time, so that huge corpora fit in memory.
+    // Under a Zipf distribution the first words are the most frequent ones
+    SearchServer search_server(vector<string>{dictionary[0]});
+    {
+        Measurement& ingest = measurements.emplace_back("add_document"s);
+        vector<string> recent_texts;
+        const size_t recent_text_count = 1024;
+        for (int id = 0; id < config.documents; ++id) {
+            string text;
+            if (!recent_texts.empty() && uniform_real_distribution<>(0, 1)(generator) < config.duplicates) {
+                text = recent_texts[uniform_int_distribution<size_t>(0, recent_texts.size() - 1)(generator)];
+            } else {
+                text = GenerateQuery(generator, dictionary, distribution, config.words_per_document);
+            }
+            const vector<int> ratings = {uniform_int_distribution(-10, 10)(generator), uniform_int_distribution(-10, 10)(generator)};
+            ingest.Run([&] {
+                search_server.AddDocument(id, text, DocumentStatus::ACTUAL, ratings);
+            });
+            if (recent_texts.size() < recent_text_count) {
+                recent_texts.push_back(move(text));
+            } else {
+                recent_texts[id % recent_text_count] = move(text);
+            }
+        }
+    }
+
+    EnableQueryStats(config.query_stats);
+    for (const auto& [name, engine] : {pair{"find_top_documents_exhaustive"s, QueryEngine::EXHAUSTIVE},
+                                       pair{"find_top_documents_block_max_wand"s, QueryEngine::BLOCK_MAX_WAND}}) {
+        search_server.SetQueryEngine(engine);
+        Measurement& measurement = measurements.emplace_back(name);
+        for (const string& query : queries) {
+            measurement.Run([&] {
+                AddChecksum(search_server.FindTopDocuments(query));
+            });
+        }
+    }
+    search_server.SetQueryEngine(QueryEngine::EXHAUSTIVE);
+    {
+        Measurement& measurement = measurements.emplace_back("find_top_documents_seq"s);
+        for (const string& query : queries) {
+            measurement.Run([&] {
+                AddChecksum(search_server.FindTopDocuments(execution::seq, query));
+            });
+        }
+    }
+    {
+        Measurement& measurement = measurements.emplace_back("find_top_documents_par"s);
+        for (const string& query : queries) {
+            measurement.Run([&] {
+                AddChecksum(search_server.FindTopDocuments(execution::par, query));
+            });
+        }
+    }
+
+    {
+        Measurement& measurement = measurements.emplace_back("match_document"s);
+        uniform_int_distribution<int> document_ids(0, config.documents - 1);
+        for (const string& query : queries) {
+            const int document_id = document_ids(generator);
+            measurement.Run([&] {
+                const auto [words, status] = search_server.MatchDocument(query, document_id);
+                checksum += words.size();
+            });
+        }
+    }
+    {
+        Measurement& measurement = measurements.emplace_back("match_document_par"s);
+        uniform_int_distribution<int> document_ids(0, config.documents - 1);
+        for (const string& query : queries) {
+            const int document_id = document_ids(generator);
+            measurement.Run([&] {
+                const auto [words, status] = search_server.MatchDocument(execution::par, query, document_id);
+                checksum += words.size();
+            });
+        }
+    }
+    {
+        Measurement& measurement = measurements.emplace_back("match_documents"s, search_server.GetDocumentCount());
+        MatchResults matches;
+        for (const string& query : queries) {
+            measurement.Run([&] {
+                search_server.MatchDocuments(query, matches);
+                checksum += matches.size();
+            });
+        }
+    }
+
+    {
+        Measurement& measurement = measurements.emplace_back("process_queries"s, queries.size());
+        for (int run = 0; run < config.batch_runs; ++run) {
+            measurement.Run([&] {
+                for (const vector<Document>& documents : ProcessQueries(search_server, queries)) {
+                    AddChecksum(documents);
+                }
+            });
+        }
+    }
+
+    {
+        vector<int> document_ids(config.documents);
+        iota(document_ids.begin(), document_ids.end(), 0);
+        shuffle(document_ids.begin(), document_ids.end(), generator);
+        document_ids.resize(min<size_t>(max(config.removals, 0), document_ids.size()));
+        Measurement& removal = measurements.emplace_back("remove_document"s);
+        for (const int document_id : document_ids) {
+            removal.Run([&] {
+                search_server.RemoveDocument(document_id);
+            });
+        }
+        measurements.emplace_back("compact"s).Run([&] {
+            search_server.Compact();
+        });
+    }
+
+    {
+        const int document_count = search_server.GetDocumentCount();
+        Measurement& measurement = measurements.emplace_back("remove_duplicates"s, document_count);
+        // RemoveDuplicates reports every duplicate to cout, which holds the JSON
+        streambuf* const out = cout.rdbuf(nullptr);
+        measurement.Run([&] {
+            RemoveDuplicates(search_server);
+        });
+        cout.rdbuf(out);
+        checksum += document_count - search_server.GetDocumentCount();
+    }
+
+    cout << "{\"config\": {\"documents\": "s << config.documents
+         << ", \"dictionary\": "s << dictionary.size()
+         << ", \"words_per_document\": "s << config.words_per_document
+         << ", \"queries\": "s << config.queries
+         << ", \"words_per_query\": "s << config.words_per_query
+         << ", \"minus_prob\": "s << config.minus_prob
+         << ", \"zipf\": "s << config.zipf
+         << ", \"duplicates\": "s << config.duplicates
+         << ", \"removals\": "s << config.removals
+         << ", \"batch_runs\": "s << config.batch_runs
+         << ", \"seed\": "s << config.seed
+         << ", \"query_stats\": "s << (config.query_stats ? "true"s : "false"s)
+         << ", \"threads\": "s << thread::hardware_concurrency() << "},\n"s;
+    cout << " \"results\": [\n"s;
+    for (size_t i = 0; i < measurements.size(); ++i) {
+        cout << "  "s;
+        measurements[i].PrintJson(cout);
+        cout << (i + 1 < measurements.size() ? ",\n"s : "\n"s);
+    }
+    cout << " ],\n"s;
+    if (config.query_stats) {
+        cout << " \"query_stats\": "s;
+        PrintQueryStatsJson(cout, GetQueryStats());
+        cout << ",\n"s;
+    }
+    cout << " \"checksum\": "s << checksum << "}"s << endl;
+    return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+
+// Synthetic words, documents and queries for benchmarks
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+// Words are drawn uniformly from the dictionary
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count,
+                          double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                                         int query_count, int max_word_count);
+
+
+// Draws ranks 0..size-1 with probability proportional to 1 / (rank + 1)^exponent,
+// the word frequency law of natural text. Exponent 0 is the uniform distribution
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t size, double exponent);
+
+    size_t operator()(std::mt19937& generator) const;
+
+private:
+    // Cumulative probabilities of the ranks
+    std::vector<double> cdf_;
+};
+
+// Same as GenerateQuery, with dictionary[rank] drawn from the distribution
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                          const ZipfDistribution& distribution, int word_count, double minus_prob = 0);
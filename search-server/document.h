@@ -3,6 +3,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 
 struct Document {
     Document() = default;
@@ -23,9 +24,12 @@ enum class DocumentStatus {
     REMOVED,
 };
 
-struct DocumentData {
-    int rating;
-    DocumentStatus status;
+// Arguments of one SearchServer::AddDocument call, for bulk ingestion
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
 };
 
 void PrintDocument(const Document& document);
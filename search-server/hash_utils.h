@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+
+// splitmix64 finalizer: every input bit affects every output bit
+inline uint64_t Mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
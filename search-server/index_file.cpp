@@ -0,0 +1,116 @@
+#include "index_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw runtime_error("Cannot open index file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1 || file_stat.st_size == 0) {
+        close(fd);
+        throw runtime_error("Cannot map index file "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw runtime_error("Cannot map index file "s + path);
+    }
+    data_ = static_cast<const char*>(data);
+}
+
+MappedFile::~MappedFile() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+const char* MappedFile::data() const {
+    return data_;
+}
+
+size_t MappedFile::size() const {
+    return size_;
+}
+
+
+IndexFileWriter::IndexFileWriter(const string& path)
+    : out_(path, ios::binary | ios::trunc)
+    , path_(path) {
+    if (!out_) {
+        throw runtime_error("Cannot create index file "s + path);
+    }
+    WriteBytes(index_file::MAGIC, sizeof(index_file::MAGIC));
+    Write(index_file::VERSION);
+    Write(index_file::BYTE_ORDER_MARK);
+}
+
+void IndexFileWriter::Close() {
+    out_.close();
+    if (!out_) {
+        throw runtime_error("Cannot write index file "s + path_);
+    }
+}
+
+void IndexFileWriter::WriteBytes(const void* data, size_t size) {
+    out_.write(static_cast<const char*>(data), static_cast<streamsize>(size));
+    position_ += size;
+}
+
+void IndexFileWriter::Pad() {
+    static const char zeros[index_file::ALIGNMENT] = {};
+    WriteBytes(zeros, (index_file::ALIGNMENT - position_ % index_file::ALIGNMENT) % index_file::ALIGNMENT);
+}
+
+
+IndexFileReader::IndexFileReader(shared_ptr<const MappedFile> file)
+    : file_(move(file)) {
+    const char* magic = ReadBytes(sizeof(index_file::MAGIC));
+    if (!equal(magic, magic + sizeof(index_file::MAGIC), index_file::MAGIC)) {
+        throw runtime_error("Not an index file"s);
+    }
+    if (Read<uint32_t>() != index_file::VERSION || Read<uint32_t>() != index_file::BYTE_ORDER_MARK) {
+        throw runtime_error("Unsupported index file format"s);
+    }
+}
+
+vector<string_view> IndexFileReader::ReadStrings() {
+    const auto [ends, count] = ReadArray<uint64_t>();
+    const auto [characters, size] = ReadArray<char>();
+    vector<string_view> strings;
+    strings.reserve(count);
+    uint64_t begin = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (ends[i] < begin || ends[i] > size) {
+            throw runtime_error("Index file is corrupted"s);
+        }
+        strings.emplace_back(characters + begin, ends[i] - begin);
+        begin = ends[i];
+    }
+    return strings;
+}
+
+bool IndexFileReader::AtEnd() const {
+    return position_ == file_->size();
+}
+
+const char* IndexFileReader::ReadBytes(size_t size) {
+    if (size > file_->size() - position_) {
+        throw runtime_error("Index file is truncated"s);
+    }
+    const char* data = file_->data() + position_;
+    position_ += size;
+    return data;
+}
+
+void IndexFileReader::Align() {
+    const size_t padding = (index_file::ALIGNMENT - position_ % index_file::ALIGNMENT) % index_file::ALIGNMENT;
+    position_ = min(position_ + padding, file_->size());
+}
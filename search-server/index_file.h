@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// Binary index files are written in the native byte order and layout of the
+// machine and are meant to be read back by the same build.
+//
+// The file starts with a header (magic, format version, byte order mark)
+// followed by a sequence of values and arrays. Every array is stored as its
+// element count and the raw elements, starting at a multiple of ALIGNMENT, so
+// a reader can hand out pointers straight into the mapped file.
+namespace index_file {
+
+const char MAGIC[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+const uint32_t VERSION = 3;
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const size_t ALIGNMENT = 8;
+
+}  // namespace index_file
+
+
+// Read-only memory mapping of a whole file. Pages are loaded by the OS on first access
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const;
+    size_t size() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+
+class IndexFileWriter {
+public:
+    // Writes the file header
+    explicit IndexFileWriter(const std::string& path);
+
+    template <typename T>
+    void Write(const T& value);
+    template <typename T>
+    void WriteArray(const T* values, size_t count);
+    // Stored as one array of end offsets and one array of characters
+    template <typename StringContainer>
+    void WriteStrings(const StringContainer& strings);
+
+    // Throws if anything failed to reach the file
+    void Close();
+
+private:
+    std::ofstream out_;
+    std::string path_;
+    uint64_t position_ = 0;
+
+    void WriteBytes(const void* data, size_t size);
+    // Pads the file to the next multiple of ALIGNMENT
+    void Pad();
+};
+
+
+// Reads the values in the order IndexFileWriter wrote them. Throws
+// std::runtime_error if the file is not a valid index file.
+class IndexFileReader {
+public:
+    // Checks the file header
+    explicit IndexFileReader(std::shared_ptr<const MappedFile> file);
+
+    template <typename T>
+    T Read();
+    // The returned pointer points into the mapped file
+    template <typename T>
+    std::pair<const T*, size_t> ReadArray();
+    // The returned views point into the mapped file
+    std::vector<std::string_view> ReadStrings();
+
+    bool AtEnd() const;
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    size_t position_ = 0;
+
+    const char* ReadBytes(size_t size);
+    // Moves to the next multiple of ALIGNMENT
+    void Align();
+};
+
+
+template <typename T>
+void IndexFileWriter::Write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    WriteBytes(&value, sizeof(T));
+}
+
+template <typename T>
+void IndexFileWriter::WriteArray(const T* values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= index_file::ALIGNMENT);
+    Pad();
+    Write(static_cast<uint64_t>(count));
+    WriteBytes(values, count * sizeof(T));
+}
+
+template <typename StringContainer>
+void IndexFileWriter::WriteStrings(const StringContainer& strings) {
+    std::vector<uint64_t> ends;
+    std::string characters;
+    for (const std::string_view str : strings) {
+        characters += str;
+        ends.push_back(characters.size());
+    }
+    WriteArray(ends.data(), ends.size());
+    WriteArray(characters.data(), characters.size());
+}
+
+template <typename T>
+T IndexFileReader::Read() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    std::memcpy(&value, ReadBytes(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template <typename T>
+std::pair<const T*, size_t> IndexFileReader::ReadArray() {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= index_file::ALIGNMENT);
+    Align();
+    const uint64_t count = Read<uint64_t>();
+    if (count > (file_->size() - position_) / sizeof(T)) {
+        throw std::runtime_error("Index file is truncated");
+    }
+    const T* values = reinterpret_cast<const T*>(ReadBytes(count * sizeof(T)));
+    return {values, count};
+}
@@ -2,10 +2,13 @@
 
 #include <chrono>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 #define PROFILE_CONCAT_INTERNAL(X, Y) X##Y
 #define PROFILE_CONCAT(X, Y) PROFILE_CONCAT_INTERNAL(X, Y)
 #define UNIQUE_VAR_NAME_PROFILE PROFILE_CONCAT(profileGuard, __LINE__)
+#define LOG_DURATION(x) LogDuration UNIQUE_VAR_NAME_PROFILE(x)
 #define LOG_DURATION_STREAM(x, y) LogDuration UNIQUE_VAR_NAME_PROFILE(x,y)
 
 class LogDuration {
@@ -13,10 +16,10 @@ public:
     
     using Clock = std::chrono::steady_clock;
 
-    LogDuration(const std::string& id) : id_(id), out_ (std::cerr) {
+    LogDuration(std::string_view id) : id_(id), out_ (std::cerr) {
     }
     
-    LogDuration(const std::string& id, std::ostream& out):id_(id), out_ (out) {
+    LogDuration(std::string_view id, std::ostream& out):id_(id), out_ (out) {
     }
 
     ~LogDuration() {
@@ -1,56 +1,18 @@
+#include "corpus_generator.h"
 #include "process_queries.h"
+#include "test_example_functions.h"
 #include "search_server.h"
+#include "log_duration.h"
 
 #include <execution>
+#include <filesystem>
+#include <random>
 #include <iostream>
 #include <string>
 #include <vector>
 
 using namespace std;
 
-string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution('a', 'z')(generator));
-    }
-    return word;
-}
-
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
-    }
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
-}
-
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
-        }
-        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
-            query.push_back('-');
-        }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
-    }
-    return query;
-}
-
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
-    }
-    return queries;
-}
-
 template <typename ExecutionPolicy>
 void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
     LOG_DURATION(mark);
@@ -114,5 +76,16 @@ mt19937 generator;
     TEST(seq);
     TEST(par);
 
+    if (!TestQueryEnginesMatch(generator)) {
+        return 1;
+    }
+    cout << "Query engines OK"s << endl;
+
+    const string index_path = (filesystem::temp_directory_path() / "search_server_round_trip.idx"s).string();
+    if (!TestIndexRoundTrip(search_server_, queries, index_path)) {
+        return 1;
+    }
+    cout << "Index round trip OK"s << endl;
+
     return 0;
 }
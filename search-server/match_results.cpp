@@ -0,0 +1,20 @@
+#include "match_results.h"
+
+using namespace std;
+
+
+size_t MatchResults::size() const {
+    return document_ids_.size();
+}
+
+MatchResults::Match MatchResults::operator[](size_t index) const {
+    return {document_ids_[index], statuses_[index],
+            {words_.begin() + offsets_[index], words_.begin() + offsets_[index + 1]}};
+}
+
+void MatchResults::clear() {
+    document_ids_.clear();
+    statuses_.clear();
+    words_.clear();
+    offsets_.assign(1, 0);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "paginator.h"
+
+
+// Results of SearchServer::MatchDocuments: for each document, the plus words
+// of the query it contains, all kept back to back in one array. Passing the
+// same object to the next call reuses its memory.
+class MatchResults {
+public:
+    using WordIterator = std::vector<std::string_view>::const_iterator;
+
+    struct Match {
+        int document_id;
+        DocumentStatus status;
+        // Sorted, as MatchDocument returns them
+        IteratorRange<WordIterator> words;
+    };
+
+    // Number of documents
+    size_t size() const;
+    Match operator[](size_t index) const;
+
+    void clear();
+
+private:
+    std::vector<int> document_ids_;
+    std::vector<DocumentStatus> statuses_;
+    std::vector<std::string_view> words_;
+    // size() + 1 entries; words of document i are words_[offsets_[i], offsets_[i + 1])
+    std::vector<size_t> offsets_ = {0};
+
+    friend class SearchServer;
+};
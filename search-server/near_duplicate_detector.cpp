@@ -0,0 +1,191 @@
+#include "near_duplicate_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+#include "hash_utils.h"
+#include "string_processing.h"
+
+using namespace std;
+
+
+namespace {
+
+// Pairs at the Jaccard threshold are found with probability
+// 1 - (1 - threshold^rows)^bands; the S-curve of that probability is steepest
+// around (1 / bands)^(1 / rows), which is kept this far below the threshold
+const double LSH_THRESHOLD_MARGIN = 0.05;
+
+}  // namespace
+
+
+NearDuplicateDetector::NearDuplicateDetector(double jaccard_threshold, size_t signature_size)
+    : jaccard_threshold_(jaccard_threshold) {
+    if (!(jaccard_threshold > 0.0 && jaccard_threshold <= 1.0) || signature_size == 0) {
+        throw invalid_argument("Invalid near-duplicate detector options"s);
+    }
+    // The most rows per band, which means the fewest false candidates, that
+    // still puts the steep part of the curve below the threshold
+    rows_per_band_ = 1;
+    for (size_t rows = 2; rows <= signature_size; ++rows) {
+        const size_t bands = signature_size / rows;
+        if (pow(1.0 / bands, 1.0 / rows) <= jaccard_threshold - LSH_THRESHOLD_MARGIN) {
+            rows_per_band_ = rows;
+        }
+    }
+    band_count_ = signature_size / rows_per_band_;
+    bands_.resize(band_count_);
+
+    uint64_t seed = 0;
+    seeds_.reserve(signature_size);
+    for (size_t i = 0; i < signature_size; ++i) {
+        seed += 0x9e3779b97f4a7c15ULL;
+        seeds_.push_back(Mix(seed));
+    }
+}
+
+NearDuplicateDetector::Signature NearDuplicateDetector::ComputeSignature(const vector<string_view>& words) const {
+    Signature signature(seeds_.size(), numeric_limits<uint32_t>::max());
+    for (const string_view word : words) {
+        const uint64_t word_hash = hash<string_view>{}(word);
+        for (size_t i = 0; i < seeds_.size(); ++i) {
+            signature[i] = min(signature[i], static_cast<uint32_t>(Mix(word_hash ^ seeds_[i])));
+        }
+    }
+    return signature;
+}
+
+NearDuplicateDetector::Match NearDuplicateDetector::FindMostSimilar(const Signature& signature) const {
+    vector<int> candidates;
+    for (size_t band = 0; band < band_count_; ++band) {
+        const auto it = bands_[band].find(GetBucketKey(signature, band));
+        if (it != bands_[band].end()) {
+            candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+        }
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    Match best;
+    for (const int document_id : candidates) {
+        const double similarity = EstimateSimilarity(signature, signatures_.at(document_id));
+        // Candidates are in ascending id order, so ties go to the earliest document
+        if (similarity >= jaccard_threshold_ && similarity > best.similarity) {
+            best = {document_id, similarity};
+        }
+    }
+    return best;
+}
+
+void NearDuplicateDetector::Insert(int document_id, Signature signature) {
+    Erase(document_id);
+    for (size_t band = 0; band < band_count_; ++band) {
+        bands_[band][GetBucketKey(signature, band)].push_back(document_id);
+    }
+    signatures_.emplace(document_id, move(signature));
+}
+
+void NearDuplicateDetector::Erase(int document_id) {
+    const auto it = signatures_.find(document_id);
+    if (it == signatures_.end()) {
+        return;
+    }
+    for (size_t band = 0; band < band_count_; ++band) {
+        const auto bucket = bands_[band].find(GetBucketKey(it->second, band));
+        vector<int>& document_ids = bucket->second;
+        document_ids.erase(remove(document_ids.begin(), document_ids.end(), document_id), document_ids.end());
+        if (document_ids.empty()) {
+            bands_[band].erase(bucket);
+        }
+    }
+    signatures_.erase(it);
+}
+
+double NearDuplicateDetector::EstimateSimilarity(const Signature& lhs, const Signature& rhs) {
+    size_t equal_count = 0;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        equal_count += lhs[i] == rhs[i];
+    }
+    return lhs.empty() ? 0.0 : equal_count * 1.0 / lhs.size();
+}
+
+uint64_t NearDuplicateDetector::GetBucketKey(const Signature& signature, size_t band) const {
+    uint64_t key = band;
+    for (size_t row = band * rows_per_band_; row < (band + 1) * rows_per_band_; ++row) {
+        key = Mix(key ^ signature[row]) + row;
+    }
+    return key;
+}
+
+
+NearDuplicateFilter::NearDuplicateFilter(SearchServer& search_server, NearDuplicateOptions options)
+    : search_server_(search_server)
+    , policy_(options.policy)
+    , detector_(options.jaccard_threshold, options.signature_size) {
+}
+
+NearDuplicateResult NearDuplicateFilter::AddDocument(int document_id, string_view document, DocumentStatus status,
+                                                     const vector<int>& ratings) {
+    // Otherwise a rejection would hide that the id is unusable
+    if (document_id < 0 || search_server_.HasDocument(document_id)) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    vector<string_view> words = SplitIntoWords(document);
+    words.erase(remove(words.begin(), words.end(), string_view()), words.end());
+    NearDuplicateDetector::Signature signature = detector_.ComputeSignature(words);
+    const NearDuplicateDetector::Match match = detector_.FindMostSimilar(signature);
+
+    NearDuplicateResult result;
+    result.duplicate_of = match.document_id;
+    result.similarity = match.similarity;
+    if (match.document_id == NearDuplicateDetector::NO_DOCUMENT) {
+        search_server_.AddDocument(document_id, document, status, ratings);
+        detector_.Insert(document_id, move(signature));
+        return result;
+    }
+    if (policy_ == NearDuplicatePolicy::REJECT) {
+        result.added = false;
+        return result;
+    }
+
+    search_server_.AddDocument(document_id, document, status, ratings);
+    flagged_ids_.push_back(document_id);
+    if (policy_ == NearDuplicatePolicy::CLUSTER) {
+        const int cluster_id = match.document_id;
+        set<int>& cluster = clusters_[cluster_id];
+        if (cluster.empty()) {
+            cluster.insert(cluster_id);
+            cluster_ids_[cluster_id] = cluster_id;
+        }
+        cluster.insert(document_id);
+        cluster_ids_[document_id] = cluster_id;
+    }
+    return result;
+}
+
+void NearDuplicateFilter::RemoveDocument(int document_id) {
+    search_server_.RemoveDocument(document_id);
+    detector_.Erase(document_id);
+    flagged_ids_.erase(remove(flagged_ids_.begin(), flagged_ids_.end(), document_id), flagged_ids_.end());
+    const auto it = cluster_ids_.find(document_id);
+    if (it != cluster_ids_.end()) {
+        clusters_.at(it->second).erase(document_id);
+        cluster_ids_.erase(it);
+    }
+}
+
+const vector<int>& NearDuplicateFilter::GetFlaggedDocuments() const {
+    return flagged_ids_;
+}
+
+vector<int> NearDuplicateFilter::GetCluster(int document_id) const {
+    const auto it = cluster_ids_.find(document_id);
+    if (it == cluster_ids_.end()) {
+        return {document_id};
+    }
+    const set<int>& cluster = clusters_.at(it->second);
+    return {cluster.begin(), cluster.end()};
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+
+// What NearDuplicateFilter does with a document similar to an earlier one
+enum class NearDuplicatePolicy {
+    // Leaves it out of the index
+    REJECT,
+    // Indexes it and lists it in GetFlaggedDocuments
+    FLAG,
+    // Indexes it and puts it in the cluster of the earlier document
+    CLUSTER,
+};
+
+struct NearDuplicateOptions {
+    // Minimum Jaccard similarity of the word sets of two near-duplicates
+    double jaccard_threshold = 0.8;
+    NearDuplicatePolicy policy = NearDuplicatePolicy::FLAG;
+    // Number of MinHash values per document; more give a finer similarity estimate
+    size_t signature_size = 128;
+};
+
+
+// MinHash signatures of word sets, indexed for similarity search with
+// locality-sensitive hashing.
+//
+// The signature is split into bands of rows. Documents sharing all rows of
+// some band land in the same bucket of that band, so a lookup only compares
+// against the documents of as many buckets as there are bands instead of
+// against the whole corpus. The band count is chosen so that pairs at the
+// Jaccard threshold collide in some band with high probability.
+class NearDuplicateDetector {
+public:
+    using Signature = std::vector<uint32_t>;
+
+    static const int NO_DOCUMENT = -1;
+
+    struct Match {
+        int document_id = NO_DOCUMENT;
+        // Estimated Jaccard similarity
+        double similarity = 0.0;
+    };
+
+    explicit NearDuplicateDetector(double jaccard_threshold, size_t signature_size = 128);
+
+    // Repeated words count once
+    Signature ComputeSignature(const std::vector<std::string_view>& words) const;
+    // The most similar indexed document at or above the threshold; NO_DOCUMENT if none
+    Match FindMostSimilar(const Signature& signature) const;
+
+    void Insert(int document_id, Signature signature);
+    void Erase(int document_id);
+
+    // Share of equal signature positions, an unbiased estimate of Jaccard similarity
+    static double EstimateSimilarity(const Signature& lhs, const Signature& rhs);
+
+private:
+    double jaccard_threshold_;
+    size_t rows_per_band_;
+    size_t band_count_;
+    // One seed per signature position
+    std::vector<uint64_t> seeds_;
+    // Per band: bucket key -> documents
+    std::vector<std::unordered_map<uint64_t, std::vector<int>>> bands_;
+    std::unordered_map<int, Signature> signatures_;
+
+    uint64_t GetBucketKey(const Signature& signature, size_t band) const;
+};
+
+
+struct NearDuplicateResult {
+    bool added = true;
+    // The earlier document it is a near-duplicate of, if any
+    int duplicate_of = NearDuplicateDetector::NO_DOCUMENT;
+    double similarity = 0.0;
+};
+
+
+// Adds documents to a SearchServer, checking each one against the documents
+// added before it. Similarity is measured on the set of words of the text,
+// stop words included. Documents are compared with the first document of
+// each group of near-duplicates only, which keeps the buckets small however
+// many copies arrive.
+class NearDuplicateFilter {
+public:
+    explicit NearDuplicateFilter(SearchServer& search_server, NearDuplicateOptions options = {});
+
+    // Throws what SearchServer::AddDocument throws. An invalid or taken id
+    // throws std::invalid_argument even when the document would be rejected
+    NearDuplicateResult AddDocument(int document_id, std::string_view document, DocumentStatus status,
+                                    const std::vector<int>& ratings);
+    // Removing the first document of a cluster keeps the other members
+    // together, but later documents can no longer join them
+    void RemoveDocument(int document_id);
+
+    // Near-duplicates indexed under FLAG or CLUSTER, in the order they were added
+    const std::vector<int>& GetFlaggedDocuments() const;
+    // Ids of the document's cluster in ascending order; just the document if it has none
+    std::vector<int> GetCluster(int document_id) const;
+
+private:
+    SearchServer& search_server_;
+    NearDuplicatePolicy policy_;
+    NearDuplicateDetector detector_;
+    std::vector<int> flagged_ids_;
+    // Document -> first document of its cluster, for clustered documents only
+    std::map<int, int> cluster_ids_;
+    // First document of a cluster -> all its members, the first one too until it is removed
+    std::map<int, std::set<int>> clusters_;
+};
@@ -0,0 +1,502 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+namespace {
+
+const int LANES = 4;
+
+int BitWidth(uint32_t value) {
+    int bits = 0;
+    while (value != 0) {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+// Values are laid out lane by lane: value i lives in lane i % LANES at bit
+// position (i / LANES) * bits of that lane, and word w of lane l is stored
+// at index w * LANES + l.
+uint32_t PackedWordCount(int size, int bits) {
+    const uint32_t rows = (size + LANES - 1) / LANES;
+    return (rows * bits + 31) / 32 * LANES;
+}
+
+void Pack(const uint32_t* values, int size, int bits, uint32_t* out) {
+    if (bits == 0) {
+        return;
+    }
+    for (int i = 0; i < size; ++i) {
+        const uint32_t position = (i / LANES) * bits;
+        const uint32_t word = position / 32;
+        const uint32_t shift = position % 32;
+        const int lane = i % LANES;
+        out[word * LANES + lane] |= values[i] << shift;
+        if (shift + bits > 32) {
+            out[(word + 1) * LANES + lane] |= values[i] >> (32 - shift);
+        }
+    }
+}
+
+// Writes the values rounded up to a whole number of lane rows
+void Unpack(const uint32_t* in, int size, int bits, uint32_t* out) {
+    const int rows = (size + LANES - 1) / LANES;
+    if (bits == 0) {
+        fill(out, out + rows * LANES, 0u);
+        return;
+    }
+    const uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+#if defined(__SSE2__)
+    const __m128i mask_vector = _mm_set1_epi32(static_cast<int>(mask));
+    for (int row = 0; row < rows; ++row) {
+        const uint32_t position = row * bits;
+        const uint32_t word = position / 32;
+        const uint32_t shift = position % 32;
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + word * LANES));
+        __m128i value = _mm_srl_epi32(low, _mm_cvtsi32_si128(shift));
+        if (shift + bits > 32) {
+            const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + (word + 1) * LANES));
+            value = _mm_or_si128(value, _mm_sll_epi32(high, _mm_cvtsi32_si128(32 - shift)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + row * LANES), _mm_and_si128(value, mask_vector));
+    }
+#else
+    for (int row = 0; row < rows; ++row) {
+        const uint32_t position = row * bits;
+        const uint32_t word = position / 32;
+        const uint32_t shift = position % 32;
+        for (int lane = 0; lane < LANES; ++lane) {
+            uint32_t value = in[word * LANES + lane] >> shift;
+            if (shift + bits > 32) {
+                value |= in[(word + 1) * LANES + lane] << (32 - shift);
+            }
+            out[row * LANES + lane] = value & mask;
+        }
+    }
+#endif
+}
+
+// Turns deltas into absolute values in place, rounded up to whole lane rows
+void PrefixSum(uint32_t* values, int size, uint32_t base) {
+    const int rows = (size + LANES - 1) / LANES;
+#if defined(__SSE2__)
+    __m128i carry = _mm_set1_epi32(static_cast<int>(base));
+    for (int row = 0; row < rows; ++row) {
+        __m128i* address = reinterpret_cast<__m128i*>(values + row * LANES);
+        __m128i value = _mm_loadu_si128(address);
+        value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+        value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+        value = _mm_add_epi32(value, carry);
+        _mm_storeu_si128(address, value);
+        carry = _mm_shuffle_epi32(value, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+#else
+    for (int i = 0; i < rows * LANES; ++i) {
+        base += values[i];
+        values[i] = base;
+    }
+#endif
+}
+
+}  // namespace
+
+
+PostingList::PostingList(const PostingList& other)
+    : blocks_(other.blocks_)
+    , block_count_(other.block_count_)
+    , data_(other.data_)
+    , data_size_(other.data_size_)
+    , owned_blocks_(other.owned_blocks_)
+    , owned_data_(other.owned_data_)
+    , checked_blocks_(other.checked_blocks_)
+    , tail_document_ids_(other.tail_document_ids_)
+    , tail_counts_(other.tail_counts_)
+    , tail_max_term_freq_(other.tail_max_term_freq_)
+    , max_term_freq_(other.max_term_freq_)
+    , size_(other.size_) {
+    // Borrowed blocks stay shared, owned ones must point to the copies
+    if (other.blocks_ == other.owned_blocks_.data()) {
+        RefreshBlocks();
+    }
+}
+
+PostingList& PostingList::operator=(const PostingList& other) {
+    if (this != &other) {
+        PostingList copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+PostingList PostingList::Load(IndexFileReader& reader, int document_count) {
+    PostingList list;
+    list.max_term_freq_ = reader.Read<double>();
+    list.size_ = reader.Read<int32_t>();
+    tie(list.blocks_, list.block_count_) = reader.ReadArray<Block>();
+    tie(list.data_, list.data_size_) = reader.ReadArray<uint32_t>();
+
+    uint64_t offset = 0;
+    int64_t posting_count = 0;
+    int previous_document_id = -1;
+    for (size_t block_index = 0; block_index < list.block_count_; ++block_index) {
+        const Block& block = list.blocks_[block_index];
+        if (block.size == 0 || block.size > BLOCK_SIZE || block.id_bits > 32 || block.count_bits > 32
+            || block.offset != offset || block.first_document_id <= previous_document_id
+            || block.last_document_id < block.first_document_id || block.last_document_id >= document_count) {
+            throw runtime_error("Index file is corrupted"s);
+        }
+        offset += PackedWordCount(block.size, block.id_bits) + PackedWordCount(block.size, block.count_bits);
+        if (offset > list.data_size_) {
+            throw runtime_error("Index file is corrupted"s);
+        }
+        previous_document_id = block.last_document_id;
+        posting_count += block.size;
+    }
+    if (offset != list.data_size_ || posting_count != list.size_) {
+        throw runtime_error("Index file is corrupted"s);
+    }
+    // Decoding every block here would read the whole file before the first query
+    list.checked_blocks_.reset(new atomic<bool>[list.block_count_]());
+    return list;
+}
+
+void PostingList::Save(IndexFileWriter& writer) const {
+    // Loaded lists have no tail, so it is written as one more block
+    PostingList sealed(*this);
+    if (!sealed.tail_document_ids_.empty()) {
+        sealed.SealTail();
+    }
+    writer.Write(sealed.max_term_freq_);
+    writer.Write(static_cast<int32_t>(sealed.size_));
+    writer.WriteArray(sealed.blocks_, sealed.block_count_);
+    writer.WriteArray(sealed.data_, sealed.data_size_);
+}
+
+void PostingList::CheckBlocks() const {
+    if (!checked_blocks_ || blocks_ == owned_blocks_.data()) {
+        return;
+    }
+    int document_ids[BLOCK_SIZE];
+    uint32_t counts[BLOCK_SIZE];
+    for (size_t block_index = 0; block_index < block_count_; ++block_index) {
+        if (!checked_blocks_[block_index].load(memory_order_acquire)) {
+            DecodeBlock(blocks_[block_index], document_ids, counts);
+        }
+    }
+}
+
+
+void PostingList::Add(int document_id, uint32_t count, double term_freq) {
+    max_term_freq_ = max(max_term_freq_, term_freq);
+    if (block_count_ == 0 || document_id > blocks_[block_count_ - 1].last_document_id) {
+        tail_max_term_freq_ = max(tail_max_term_freq_, term_freq);
+        const auto it = lower_bound(tail_document_ids_.begin(), tail_document_ids_.end(), document_id);
+        const auto index = it - tail_document_ids_.begin();
+        if (it != tail_document_ids_.end() && *it == document_id) {
+            tail_counts_[index] = count;
+            return;
+        }
+        tail_document_ids_.insert(it, document_id);
+        tail_counts_.insert(tail_counts_.begin() + index, count);
+        ++size_;
+        if (tail_document_ids_.size() == BLOCK_SIZE) {
+            SealTail();
+        }
+        return;
+    }
+
+    // Out-of-order insert: rewrite the block that covers the id
+    const size_t block_index = FindBlock(0, document_id);
+    const Block& block = blocks_[block_index];
+    int document_ids[BLOCK_SIZE + 1];
+    uint32_t counts[BLOCK_SIZE + 1];
+    DecodeBlock(block, document_ids, counts);
+    int size = block.size;
+    const int position = lower_bound(document_ids, document_ids + size, document_id) - document_ids;
+    if (position < size && document_ids[position] == document_id) {
+        counts[position] = count;
+    } else {
+        copy_backward(document_ids + position, document_ids + size, document_ids + size + 1);
+        copy_backward(counts + position, counts + size, counts + size + 1);
+        document_ids[position] = document_id;
+        counts[position] = count;
+        ++size;
+        ++size_;
+    }
+    ReplaceBlocks(block_index, block_index + 1, document_ids, counts, size, max(block.max_term_freq, term_freq));
+}
+
+bool PostingList::Erase(int document_id) {
+    const auto tail_it = lower_bound(tail_document_ids_.begin(), tail_document_ids_.end(), document_id);
+    if (tail_it != tail_document_ids_.end() && *tail_it == document_id) {
+        tail_counts_.erase(tail_counts_.begin() + (tail_it - tail_document_ids_.begin()));
+        tail_document_ids_.erase(tail_it);
+        --size_;
+        return true;
+    }
+
+    const size_t block_index = FindBlock(0, document_id);
+    if (block_index == block_count_ || blocks_[block_index].first_document_id > document_id) {
+        return false;
+    }
+    const Block& block = blocks_[block_index];
+    int document_ids[BLOCK_SIZE];
+    uint32_t counts[BLOCK_SIZE];
+    DecodeBlock(block, document_ids, counts);
+    const int size = block.size;
+    const int position = lower_bound(document_ids, document_ids + size, document_id) - document_ids;
+    if (position == size || document_ids[position] != document_id) {
+        return false;
+    }
+    copy(document_ids + position + 1, document_ids + size, document_ids + position);
+    copy(counts + position + 1, counts + size, counts + position);
+    ReplaceBlocks(block_index, block_index + 1, document_ids, counts, size - 1, block.max_term_freq);
+    --size_;
+    return true;
+}
+
+bool PostingList::Contains(int document_id) const {
+    if (binary_search(tail_document_ids_.begin(), tail_document_ids_.end(), document_id)) {
+        return true;
+    }
+    const size_t block_index = FindBlock(0, document_id);
+    if (block_index == block_count_ || blocks_[block_index].first_document_id > document_id) {
+        return false;
+    }
+    int document_ids[BLOCK_SIZE];
+    uint32_t counts[BLOCK_SIZE];
+    DecodeBlock(blocks_[block_index], document_ids, counts);
+    return binary_search(document_ids, document_ids + blocks_[block_index].size, document_id);
+}
+
+int PostingList::size() const {
+    return size_;
+}
+
+bool PostingList::empty() const {
+    return size_ == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    // Borrowed blocks live in the page cache, not on the heap
+    return owned_blocks_.capacity() * sizeof(Block)
+           + owned_data_.capacity() * sizeof(uint32_t)
+           + tail_document_ids_.capacity() * sizeof(int)
+           + tail_counts_.capacity() * sizeof(uint32_t);
+}
+
+void PostingList::DecodeBlock(const Block& block, int* document_ids, uint32_t* counts) const {
+    const uint32_t* in = data_ + block.offset;
+    // int and uint32_t may alias each other
+    uint32_t* ids = reinterpret_cast<uint32_t*>(document_ids);
+    Unpack(in, block.size, block.id_bits, ids);
+    PrefixSum(ids, block.size, static_cast<uint32_t>(block.first_document_id));
+    Unpack(in + PackedWordCount(block.size, block.id_bits), block.size, block.count_bits, counts);
+    for (int i = 0; i < block.size; ++i) {
+        ++counts[i];
+    }
+    if (checked_blocks_ && blocks_ != owned_blocks_.data()
+        && !checked_blocks_[&block - blocks_].load(memory_order_acquire)) {
+        CheckBlock(block, document_ids);
+        checked_blocks_[&block - blocks_].store(true, memory_order_release);
+    }
+}
+
+void PostingList::CheckBlock(const Block& block, const int* document_ids) const {
+    // Deltas may wrap around, so a block is only known to be sound once decoded
+    if (document_ids[0] != block.first_document_id || document_ids[block.size - 1] != block.last_document_id) {
+        throw runtime_error("Index file is corrupted"s);
+    }
+    for (int i = 1; i < block.size; ++i) {
+        if (document_ids[i] <= document_ids[i - 1]) {
+            throw runtime_error("Index file is corrupted"s);
+        }
+    }
+}
+
+void PostingList::ReplaceBlocks(size_t first, size_t last, const int* document_ids, const uint32_t* counts, int size,
+                                double max_term_freq) {
+    MakeOwned();
+    const uint32_t begin_offset = first < block_count_ ? blocks_[first].offset : static_cast<uint32_t>(data_size_);
+    const uint32_t end_offset = last < block_count_ ? blocks_[last].offset : static_cast<uint32_t>(data_size_);
+
+    vector<Block> new_blocks;
+    vector<uint32_t> new_data;
+    const int block_count = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t values[BLOCK_SIZE];
+    for (int block_index = 0, start = 0; block_index < block_count; ++block_index) {
+        // Spread the postings evenly so that a split leaves room in both halves
+        const int block_size = (size - start) / (block_count - block_index);
+        Block block;
+        block.first_document_id = document_ids[start];
+        block.last_document_id = document_ids[start + block_size - 1];
+        block.max_term_freq = max_term_freq;
+        block.offset = begin_offset + static_cast<uint32_t>(new_data.size());
+        block.size = static_cast<uint16_t>(block_size);
+
+        uint32_t max_value = 0;
+        values[0] = 0;
+        for (int i = 1; i < block_size; ++i) {
+            values[i] = static_cast<uint32_t>(document_ids[start + i] - document_ids[start + i - 1]);
+            max_value = max(max_value, values[i]);
+        }
+        block.id_bits = static_cast<uint8_t>(BitWidth(max_value));
+        size_t position = new_data.size();
+        new_data.resize(position + PackedWordCount(block_size, block.id_bits), 0);
+        Pack(values, block_size, block.id_bits, new_data.data() + position);
+
+        max_value = 0;
+        for (int i = 0; i < block_size; ++i) {
+            values[i] = counts[start + i] - 1;
+            max_value = max(max_value, values[i]);
+        }
+        block.count_bits = static_cast<uint8_t>(BitWidth(max_value));
+        position = new_data.size();
+        new_data.resize(position + PackedWordCount(block_size, block.count_bits), 0);
+        Pack(values, block_size, block.count_bits, new_data.data() + position);
+
+        new_blocks.push_back(block);
+        start += block_size;
+    }
+
+    const int64_t shift = static_cast<int64_t>(new_data.size()) - (end_offset - begin_offset);
+    for (size_t i = last; i < block_count_; ++i) {
+        owned_blocks_[i].offset = static_cast<uint32_t>(owned_blocks_[i].offset + shift);
+    }
+    owned_data_.erase(owned_data_.begin() + begin_offset, owned_data_.begin() + end_offset);
+    owned_data_.insert(owned_data_.begin() + begin_offset, new_data.begin(), new_data.end());
+    owned_blocks_.erase(owned_blocks_.begin() + first, owned_blocks_.begin() + last);
+    owned_blocks_.insert(owned_blocks_.begin() + first, new_blocks.begin(), new_blocks.end());
+    RefreshBlocks();
+}
+
+void PostingList::SealTail() {
+    ReplaceBlocks(block_count_, block_count_, tail_document_ids_.data(), tail_counts_.data(),
+                  static_cast<int>(tail_document_ids_.size()), tail_max_term_freq_);
+    tail_document_ids_.clear();
+    tail_counts_.clear();
+    tail_max_term_freq_ = 0.0;
+}
+
+size_t PostingList::FindBlock(size_t first, int document_id) const {
+    return lower_bound(blocks_ + first, blocks_ + block_count_, document_id,
+                       [](const Block& block, int id) {
+        return block.last_document_id < id;
+    }) - blocks_;
+}
+
+void PostingList::MakeOwned() {
+    if (blocks_ != owned_blocks_.data()) {
+        // Owned blocks are trusted, so the rest are checked before the copy
+        CheckBlocks();
+        owned_blocks_.assign(blocks_, blocks_ + block_count_);
+        owned_data_.assign(data_, data_ + data_size_);
+        checked_blocks_.reset();
+    }
+}
+
+void PostingList::RefreshBlocks() {
+    blocks_ = owned_blocks_.data();
+    block_count_ = owned_blocks_.size();
+    data_ = owned_data_.data();
+    data_size_ = owned_data_.size();
+}
+
+
+PostingList::Cursor::Cursor(const PostingList& list)
+    : list_(&list) {
+    LoadBlock(0);
+}
+
+int PostingList::Cursor::GetDocumentId() const {
+    return position_ < block_size_ ? document_ids_[position_] : END;
+}
+
+uint32_t PostingList::Cursor::GetCount() const {
+    return counts_[position_];
+}
+
+void PostingList::Cursor::Next() {
+    if (++position_ == block_size_ && block_index_ < list_->block_count_) {
+        LoadBlock(block_index_ + 1);
+    }
+}
+
+void PostingList::Cursor::NextGeq(int document_id) {
+    if (GetDocumentId() >= document_id) {
+        return;
+    }
+    if (document_ids_[block_size_ - 1] < document_id) {
+        if (block_index_ == list_->block_count_) {
+            position_ = block_size_;
+            return;
+        }
+        LoadBlock(list_->FindBlock(block_index_ + 1, document_id));
+        if (block_size_ == 0 || document_ids_[block_size_ - 1] < document_id) {
+            position_ = block_size_;
+            return;
+        }
+    }
+    position_ = lower_bound(document_ids_ + position_, document_ids_ + block_size_, document_id) - document_ids_;
+}
+
+int PostingList::Cursor::GetBlockLastDocumentId(int document_id) const {
+    // Earlier blocks end before the current posting, so a document_id at or
+    // after it that the current block covers has no other block
+    if (block_index_ < list_->block_count_ && document_id <= block_last_document_id_
+        && document_id >= GetDocumentId()) {
+        return block_last_document_id_;
+    }
+    const size_t block_index = list_->FindBlock(min(block_index_, list_->block_count_), document_id);
+    if (block_index < list_->block_count_) {
+        return list_->blocks_[block_index].last_document_id;
+    }
+    const auto& tail = list_->tail_document_ids_;
+    return !tail.empty() && tail.back() >= document_id ? tail.back() : END;
+}
+
+double PostingList::Cursor::GetBlockMaxTermFreq(int document_id) const {
+    if (block_index_ < list_->block_count_ && document_id <= block_last_document_id_
+        && document_id >= GetDocumentId()) {
+        return block_max_term_freq_;
+    }
+    const size_t block_index = list_->FindBlock(min(block_index_, list_->block_count_), document_id);
+    if (block_index < list_->block_count_) {
+        return list_->blocks_[block_index].max_term_freq;
+    }
+    const auto& tail = list_->tail_document_ids_;
+    return !tail.empty() && tail.back() >= document_id ? list_->tail_max_term_freq_ : 0.0;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block_index) {
+    block_index_ = block_index;
+    position_ = 0;
+    if (block_index < list_->block_count_) {
+        const Block& block = list_->blocks_[block_index];
+        list_->DecodeBlock(block, document_ids_buffer_, counts_buffer_);
+        document_ids_ = document_ids_buffer_;
+        counts_ = counts_buffer_;
+        block_size_ = block.size;
+        block_last_document_id_ = block.last_document_id;
+        block_max_term_freq_ = block.max_term_freq;
+    } else {
+        document_ids_ = list_->tail_document_ids_.data();
+        counts_ = list_->tail_counts_.data();
+        block_size_ = static_cast<int>(list_->tail_document_ids_.size());
+    }
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "index_file.h"
+
+
+// Sorted list of (document id, term count) pairs for one term.
+//
+// Postings are kept in immutable compressed blocks of BLOCK_SIZE entries:
+// document ids are delta-encoded and, like the counts, bit-packed with
+// the smallest width that fits the block. Values are interleaved across
+// four 32-bit lanes so that one SSE2 step unpacks four of them at once.
+// The newest postings wait in a small uncompressed tail until it fills.
+//
+// Every block also records an upper bound of the term frequencies inside
+// it, which lets dynamic pruning skip whole blocks without decoding them.
+//
+// A list loaded from an index file reads its blocks straight from the
+// mapped file and copies them only when it is first modified. Their
+// contents are checked when each block is first decoded.
+class PostingList {
+public:
+    static const int BLOCK_SIZE = 128;
+
+    class Cursor;
+
+    PostingList() = default;
+    PostingList(const PostingList& other);
+    PostingList& operator=(const PostingList& other);
+    PostingList(PostingList&&) = default;
+    PostingList& operator=(PostingList&&) = default;
+
+    // The returned list borrows the blocks, so the file must stay mapped while it is in use.
+    // Only the block headers are checked here; throws std::runtime_error if one is
+    // malformed or has an id not below document_count. Any later call that decodes
+    // a malformed block throws std::runtime_error as well
+    static PostingList Load(IndexFileReader& reader, int document_count);
+    void Save(IndexFileWriter& writer) const;
+    // Decodes the borrowed blocks not checked yet, so that parallel code, where
+    // an exception would terminate the program, never meets a malformed one
+    void CheckBlocks() const;
+
+    // Inserts the posting or, if the document is already present, replaces its count.
+    // term_freq is the frequency the caller scores this posting with
+    void Add(int document_id, uint32_t count, double term_freq);
+    // Returns false if the document is absent
+    bool Erase(int document_id);
+
+    bool Contains(int document_id) const;
+    int size() const;
+    bool empty() const;
+
+    // Calls func(document_id, count) for each posting in ascending document id order
+    template <typename Func>
+    void ForEach(Func func) const;
+    // Same as ForEach, restricted to document ids in [first_document_id, last_document_id)
+    template <typename Func>
+    void ForEachInRange(int first_document_id, int last_document_id, Func func) const;
+
+    // Upper bound of the term frequency over the whole list
+    double GetMaxTermFreq() const;
+
+    // Number of bytes used by the postings themselves
+    size_t GetMemoryUsage() const;
+
+private:
+    struct Block {
+        int first_document_id;
+        int last_document_id;
+        double max_term_freq;
+        uint32_t offset;
+        uint16_t size;
+        uint8_t id_bits;
+        uint8_t count_bits;
+    };
+
+    // Point either into owned_blocks_ and owned_data_ or into a mapped index file
+    const Block* blocks_ = nullptr;
+    size_t block_count_ = 0;
+    const uint32_t* data_ = nullptr;
+    size_t data_size_ = 0;
+    std::vector<Block> owned_blocks_;
+    std::vector<uint32_t> owned_data_;
+    // Per borrowed block: whether its decoded ids were found consistent with its
+    // header. Shared by copies, which borrow the same blocks; null once owned
+    std::shared_ptr<std::atomic<bool>[]> checked_blocks_;
+    std::vector<int> tail_document_ids_;
+    std::vector<uint32_t> tail_counts_;
+    double tail_max_term_freq_ = 0.0;
+    double max_term_freq_ = 0.0;
+    int size_ = 0;
+
+    // Output buffers must hold BLOCK_SIZE values. Throws std::runtime_error
+    // if a borrowed block decodes to ids that disagree with its header
+    void DecodeBlock(const Block& block, int* document_ids, uint32_t* counts) const;
+    void CheckBlock(const Block& block, const int* document_ids) const;
+    // Replaces blocks [first, last) with blocks encoded from the given postings.
+    // Erasing never lowers max_term_freq, so the bounds stay valid but may loosen
+    void ReplaceBlocks(size_t first, size_t last, const int* document_ids, const uint32_t* counts, int size,
+                       double max_term_freq);
+    void SealTail();
+    // Copies borrowed blocks into the owned vectors, checking the ones never decoded
+    void MakeOwned();
+    void RefreshBlocks();
+    // Index of the first block whose last document id is not less than document_id
+    size_t FindBlock(size_t first, int document_id) const;
+};
+
+
+// Forward-only iterator for document-at-a-time traversal. Blocks are
+// decoded lazily, and the block bounds can be inspected without decoding.
+class PostingList::Cursor {
+public:
+    static const int END = std::numeric_limits<int>::max();
+
+    explicit Cursor(const PostingList& list);
+    // The cursor points into its own decode buffers
+    Cursor(const Cursor&) = delete;
+    Cursor& operator=(const Cursor&) = delete;
+
+    // END once the list is exhausted
+    int GetDocumentId() const;
+    uint32_t GetCount() const;
+
+    void Next();
+    // Moves to the first posting with a document id not less than document_id
+    void NextGeq(int document_id);
+
+    // Bounds of the block that would hold document_id: its last document id
+    // (END past the list) and the maximum term frequency inside it
+    int GetBlockLastDocumentId(int document_id) const;
+    double GetBlockMaxTermFreq(int document_id) const;
+
+private:
+    const PostingList* list_;
+    // block_count_ stands for the tail
+    size_t block_index_ = 0;
+    int position_ = 0;
+    int block_size_ = 0;
+    const int* document_ids_ = nullptr;
+    const uint32_t* counts_ = nullptr;
+    // Bounds of the current block, which most bound lookups land in
+    int block_last_document_id_ = END;
+    double block_max_term_freq_ = 0.0;
+    int document_ids_buffer_[BLOCK_SIZE];
+    uint32_t counts_buffer_[BLOCK_SIZE];
+
+    void LoadBlock(size_t block_index);
+};
+
+
+template <typename Func>
+void PostingList::ForEach(Func func) const {
+    int document_ids[BLOCK_SIZE];
+    uint32_t counts[BLOCK_SIZE];
+    for (size_t block_index = 0; block_index < block_count_; ++block_index) {
+        const Block& block = blocks_[block_index];
+        DecodeBlock(block, document_ids, counts);
+        for (int i = 0; i < block.size; ++i) {
+            func(document_ids[i], counts[i]);
+        }
+    }
+    for (size_t i = 0; i < tail_document_ids_.size(); ++i) {
+        func(tail_document_ids_[i], tail_counts_[i]);
+    }
+}
+
+template <typename Func>
+void PostingList::ForEachInRange(int first_document_id, int last_document_id, Func func) const {
+    int document_ids[BLOCK_SIZE];
+    uint32_t counts[BLOCK_SIZE];
+    for (size_t block_index = FindBlock(0, first_document_id);
+         block_index < block_count_ && blocks_[block_index].first_document_id < last_document_id;
+         ++block_index) {
+        const Block& block = blocks_[block_index];
+        DecodeBlock(block, document_ids, counts);
+        for (int i = 0; i < block.size; ++i) {
+            if (document_ids[i] >= first_document_id && document_ids[i] < last_document_id) {
+                func(document_ids[i], counts[i]);
+            }
+        }
+    }
+    auto it = std::lower_bound(tail_document_ids_.begin(), tail_document_ids_.end(), first_document_id);
+    for (; it != tail_document_ids_.end() && *it < last_document_id; ++it) {
+        func(*it, tail_counts_[it - tail_document_ids_.begin()]);
+    }
+}
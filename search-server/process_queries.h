@@ -14,6 +14,7 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::vector<Document> ProcessQueriesJoined(
+// All results in one array, query after query; see QueryResults for per-query access
+QueryResults ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
@@ -0,0 +1,62 @@
+#include "query_result_cache.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+double QueryCacheStats::GetHitRate() const {
+    const uint64_t lookups = hits + misses;
+    return lookups == 0 ? 0.0 : hits * 1.0 / lookups;
+}
+
+
+QueryResultCache::QueryResultCache(size_t capacity)
+    : capacity_(max<size_t>(capacity, 1)) {
+}
+
+bool QueryResultCache::Find(const string& key, uint64_t epoch, vector<Document>& documents) {
+    lock_guard guard(mutex_);
+    MoveToEpoch(epoch);
+    const auto it = index_.find(key);
+    if (it == index_.end() || epoch < epoch_) {
+        ++stats_.misses;
+        return false;
+    }
+    ++stats_.hits;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    documents = it->second->documents;
+    return true;
+}
+
+void QueryResultCache::Insert(const string& key, uint64_t epoch, const vector<Document>& documents) {
+    lock_guard guard(mutex_);
+    MoveToEpoch(epoch);
+    // Results of an older index must not outlive it
+    if (epoch < epoch_ || index_.count(key) > 0) {
+        return;
+    }
+    if (entries_.size() == capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+    entries_.push_front({key, documents});
+    index_.emplace(entries_.front().key, entries_.begin());
+}
+
+QueryCacheStats QueryResultCache::GetStats() const {
+    lock_guard guard(mutex_);
+    return stats_;
+}
+
+size_t QueryResultCache::GetCapacity() const {
+    return capacity_;
+}
+
+void QueryResultCache::MoveToEpoch(uint64_t epoch) {
+    if (epoch > epoch_) {
+        entries_.clear();
+        index_.clear();
+        epoch_ = epoch;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+
+struct QueryCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    // Zero before the first lookup
+    double GetHitRate() const;
+};
+
+
+// Bounded, thread-safe LRU cache of search results. Entries belong to an
+// index epoch: the first lookup or insertion with a newer epoch drops
+// everything cached before it.
+class QueryResultCache {
+public:
+    explicit QueryResultCache(size_t capacity);
+
+    // Returns false on a miss
+    bool Find(const std::string& key, uint64_t epoch, std::vector<Document>& documents);
+    void Insert(const std::string& key, uint64_t epoch, const std::vector<Document>& documents);
+
+    QueryCacheStats GetStats() const;
+    size_t GetCapacity() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::vector<Document> documents;
+    };
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    uint64_t epoch_ = 0;
+    // Most recently used first
+    std::list<Entry> entries_;
+    // Keys point into entries_
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+    QueryCacheStats stats_;
+
+    // Requires mutex_
+    void MoveToEpoch(uint64_t epoch);
+};
@@ -0,0 +1,48 @@
+#include "query_results.h"
+
+#include <numeric>
+
+using namespace std;
+
+
+size_t QueryResults::size() const {
+    return documents_.size();
+}
+
+const Document& QueryResults::operator[](size_t index) const {
+    return documents_[index];
+}
+
+size_t QueryResults::query_count() const {
+    return offsets_.size() - 1;
+}
+
+IteratorRange<QueryResults::Iterator> QueryResults::query(size_t query_index) const {
+    return {documents_.begin() + offsets_[query_index], documents_.begin() + offsets_[query_index + 1]};
+}
+
+QueryResults::Iterator QueryResults::begin() const {
+    return documents_.begin();
+}
+
+QueryResults::Iterator QueryResults::end() const {
+    return documents_.end();
+}
+
+const vector<Document>& QueryResults::documents() const {
+    return documents_;
+}
+
+const vector<size_t>& QueryResults::offsets() const {
+    return offsets_;
+}
+
+QueryResults::QueryResults(const vector<size_t>& counts)
+    : offsets_(counts.size() + 1, 0) {
+    partial_sum(counts.begin(), counts.end(), offsets_.begin() + 1);
+    documents_.resize(offsets_.back());
+}
+
+Document* QueryResults::GetSlots(size_t query_index) {
+    return documents_.data() + offsets_[query_index];
+}
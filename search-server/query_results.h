@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "document.h"
+#include "paginator.h"
+
+
+// Results of a batch of queries stored back to back in one array. The
+// documents of query i are documents()[offsets()[i], offsets()[i + 1]).
+// As a container it holds the documents, like the vector it replaces.
+class QueryResults {
+public:
+    using Iterator = std::vector<Document>::const_iterator;
+
+    QueryResults() = default;
+
+    // Number of documents of all queries
+    size_t size() const;
+    const Document& operator[](size_t index) const;
+    size_t query_count() const;
+    // Results of one query, ordered as FindTopDocuments orders them
+    IteratorRange<Iterator> query(size_t query_index) const;
+
+    // All documents, query after query
+    Iterator begin() const;
+    Iterator end() const;
+    const std::vector<Document>& documents() const;
+    // query_count() + 1 entries, the last one is size()
+    const std::vector<size_t>& offsets() const;
+
+private:
+    std::vector<Document> documents_;
+    std::vector<size_t> offsets_ = {0};
+
+    // Lays out room for counts[i] documents of query i. Each query then writes
+    // its results once, straight to GetSlots, which may run concurrently for
+    // different queries
+    explicit QueryResults(const std::vector<size_t>& counts);
+    Document* GetSlots(size_t query_index);
+
+    friend class SearchServer;
+};
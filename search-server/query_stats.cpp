@@ -0,0 +1,259 @@
+#include "query_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <set>
+
+using namespace std;
+
+
+void LatencyHistogram::Record(uint64_t nanoseconds, uint64_t count) {
+    buckets_[GetBucket(nanoseconds)] += count;
+    count_ += count;
+    total_ += nanoseconds * count;
+    max_ = max(max_, nanoseconds);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        buckets_[bucket] += other.buckets_[bucket];
+    }
+    count_ += other.count_;
+    total_ += other.total_;
+    max_ = max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return count_;
+}
+
+uint64_t LatencyHistogram::GetTotal() const {
+    return total_;
+}
+
+uint64_t LatencyHistogram::GetMax() const {
+    return max_;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double fraction) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    const uint64_t rank = max<uint64_t>(static_cast<uint64_t>(ceil(fraction * count_)), 1);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += buckets_[bucket];
+        if (seen >= rank) {
+            return min(GetBucketUpperBound(bucket), max_);
+        }
+    }
+    return max_;
+}
+
+size_t LatencyHistogram::GetBucket(uint64_t nanoseconds) {
+    const uint64_t sub_bucket_count = uint64_t{1} << SUB_BUCKET_BITS;
+    if (nanoseconds < sub_bucket_count) {
+        return nanoseconds;
+    }
+    int top_bit = 63;
+    while ((nanoseconds >> top_bit) == 0) {
+        --top_bit;
+    }
+    const int shift = top_bit - SUB_BUCKET_BITS;
+    const uint64_t sub_bucket = (nanoseconds >> shift) & (sub_bucket_count - 1);
+    return ((shift + 1) << SUB_BUCKET_BITS) + sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+    const uint64_t sub_bucket_count = uint64_t{1} << SUB_BUCKET_BITS;
+    if (bucket < sub_bucket_count) {
+        return bucket;
+    }
+    const int shift = static_cast<int>(bucket >> SUB_BUCKET_BITS) - 1;
+    const uint64_t sub_bucket = bucket & (sub_bucket_count - 1);
+    const uint64_t lower_bound = (sub_bucket_count + sub_bucket) << shift;
+    return lower_bound + ((uint64_t{1} << shift) - 1);
+}
+
+
+const LatencyHistogram& QueryStatsSnapshot::GetStage(QueryStage stage) const {
+    return stages[static_cast<size_t>(stage)];
+}
+
+uint64_t QueryStatsSnapshot::GetCounter(QueryCounter counter) const {
+    return counters[static_cast<size_t>(counter)];
+}
+
+
+// Records of one thread. Only that thread writes them, but snapshots read
+// them concurrently, hence the relaxed atomics
+struct ThreadQueryStats {
+    struct Histogram {
+        array<atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> buckets{};
+        atomic<uint64_t> count{0};
+        atomic<uint64_t> total{0};
+        atomic<uint64_t> max{0};
+    };
+    array<Histogram, QUERY_STAGE_COUNT> stages;
+    array<atomic<uint64_t>, QUERY_COUNTER_COUNT> counters{};
+
+    void Record(QueryStage stage, uint64_t nanoseconds) {
+        Histogram& histogram = stages[static_cast<size_t>(stage)];
+        histogram.buckets[LatencyHistogram::GetBucket(nanoseconds)].fetch_add(1, memory_order_relaxed);
+        histogram.count.fetch_add(1, memory_order_relaxed);
+        histogram.total.fetch_add(nanoseconds, memory_order_relaxed);
+        if (nanoseconds > histogram.max.load(memory_order_relaxed)) {
+            histogram.max.store(nanoseconds, memory_order_relaxed);
+        }
+    }
+
+    void AddTo(QueryStatsSnapshot& snapshot) const {
+        for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+            const Histogram& histogram = stages[stage];
+            LatencyHistogram& result = snapshot.stages[stage];
+            for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+                result.buckets_[bucket] += histogram.buckets[bucket].load(memory_order_relaxed);
+            }
+            result.count_ += histogram.count.load(memory_order_relaxed);
+            result.total_ += histogram.total.load(memory_order_relaxed);
+            result.max_ = std::max(result.max_, histogram.max.load(memory_order_relaxed));
+        }
+        for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+            snapshot.counters[counter] += counters[counter].load(memory_order_relaxed);
+        }
+    }
+
+    void Reset() {
+        for (Histogram& histogram : stages) {
+            for (atomic<uint64_t>& bucket : histogram.buckets) {
+                bucket.store(0, memory_order_relaxed);
+            }
+            histogram.count.store(0, memory_order_relaxed);
+            histogram.total.store(0, memory_order_relaxed);
+            histogram.max.store(0, memory_order_relaxed);
+        }
+        for (atomic<uint64_t>& counter : counters) {
+            counter.store(0, memory_order_relaxed);
+        }
+    }
+};
+
+
+namespace {
+
+atomic<bool> query_stats_enabled{false};
+
+struct QueryStatsRegistry {
+    mutex threads_mutex;
+    set<ThreadQueryStats*> live_threads;
+    // Records of the threads that have exited
+    QueryStatsSnapshot finished_threads;
+};
+
+QueryStatsRegistry& GetRegistry() {
+    // Never destroyed, so that threads exiting during shutdown can still unregister
+    static QueryStatsRegistry* registry = new QueryStatsRegistry;
+    return *registry;
+}
+
+// Keeps the stats of a thread registered while the thread runs
+struct RegisteredThreadQueryStats {
+    ThreadQueryStats stats;
+
+    RegisteredThreadQueryStats() {
+        QueryStatsRegistry& registry = GetRegistry();
+        lock_guard guard(registry.threads_mutex);
+        registry.live_threads.insert(&stats);
+    }
+
+    ~RegisteredThreadQueryStats() {
+        QueryStatsRegistry& registry = GetRegistry();
+        lock_guard guard(registry.threads_mutex);
+        stats.AddTo(registry.finished_threads);
+        registry.live_threads.erase(&stats);
+    }
+};
+
+ThreadQueryStats& GetThreadQueryStats() {
+    thread_local RegisteredThreadQueryStats registered_stats;
+    return registered_stats.stats;
+}
+
+}  // namespace
+
+
+void EnableQueryStats(bool enabled) {
+    query_stats_enabled.store(enabled, memory_order_relaxed);
+}
+
+bool IsQueryStatsEnabled() {
+    return query_stats_enabled.load(memory_order_relaxed);
+}
+
+QueryStatsSnapshot GetQueryStats() {
+    QueryStatsRegistry& registry = GetRegistry();
+    lock_guard guard(registry.threads_mutex);
+    QueryStatsSnapshot snapshot = registry.finished_threads;
+    for (const ThreadQueryStats* stats : registry.live_threads) {
+        stats->AddTo(snapshot);
+    }
+    return snapshot;
+}
+
+void ResetQueryStats() {
+    QueryStatsRegistry& registry = GetRegistry();
+    lock_guard guard(registry.threads_mutex);
+    registry.finished_threads = {};
+    for (ThreadQueryStats* stats : registry.live_threads) {
+        stats->Reset();
+    }
+}
+
+void AddQueryCounter(QueryCounter counter, uint64_t value) {
+    if (IsQueryStatsEnabled()) {
+        GetThreadQueryStats().counters[static_cast<size_t>(counter)].fetch_add(value, memory_order_relaxed);
+    }
+}
+
+
+QueryStageTimer::QueryStageTimer(QueryStage stage)
+    : stage_(stage)
+    , enabled_(IsQueryStatsEnabled()) {
+    if (enabled_) {
+        start_ = Clock::now();
+    }
+}
+
+QueryStageTimer::~QueryStageTimer() {
+    if (enabled_) {
+        const auto duration = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start_);
+        GetThreadQueryStats().Record(stage_, static_cast<uint64_t>(duration.count()));
+    }
+}
+
+
+QueryStageStopwatch::QueryStageStopwatch(QueryStage stage)
+    : stage_(stage)
+    , enabled_(IsQueryStatsEnabled()) {
+}
+
+QueryStageStopwatch::~QueryStageStopwatch() {
+    if (enabled_) {
+        const auto duration = chrono::duration_cast<chrono::nanoseconds>(total_);
+        GetThreadQueryStats().Record(stage_, static_cast<uint64_t>(duration.count()));
+    }
+}
+
+void QueryStageStopwatch::Resume() {
+    if (enabled_) {
+        start_ = Clock::now();
+    }
+}
+
+void QueryStageStopwatch::Pause() {
+    if (enabled_) {
+        total_ += Clock::now() - start_;
+    }
+}
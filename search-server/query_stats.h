@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+
+// Where the time of a query goes. Recording is off by default; when it is on,
+// every thread records into its own histograms and counters, and
+// GetQueryStats adds them up on demand.
+//
+// The sequential FindTopDocuments overloads record every stage, except that
+// block-max WAND interleaves them and records all its work as
+// POSTING_TRAVERSAL. The parallel FindTopDocuments records the scoring
+// stages once per partition of the documents, plus a TOP_K run merging the
+// partitions. The batch searches record them once per group of queries, and
+// a posting shared by several queries of the group counts once.
+// MatchDocument records MINUS_FILTER and POSTING_TRAVERSAL, MatchDocuments
+// records them once per chunk of documents and then MATERIALIZE; neither
+// adds to the counters.
+
+enum class QueryStage {
+    PARSE,
+    // Reading the posting lists of plus words and scoring their documents
+    POSTING_TRAVERSAL,
+    // Reading the posting lists of minus words
+    MINUS_FILTER,
+    // Picking the best of the scored documents
+    TOP_K,
+    // Ordering the picked documents and building the result
+    MATERIALIZE,
+};
+const size_t QUERY_STAGE_COUNT = 5;
+
+enum class QueryCounter {
+    POSTINGS_SCANNED,
+    // Documents offered to the top-K selection
+    DOCUMENTS_SCORED,
+    // Postings of plus words dropped by the document predicate or because the
+    // document was removed. Like POSTINGS_SCANNED it counts only the postings an
+    // engine looks at: block-max WAND skips most of them and drops documents with
+    // a minus word before checking the predicate
+    DOCUMENTS_FILTERED,
+};
+const size_t QUERY_COUNTER_COUNT = 3;
+
+
+// Histogram of nanosecond durations with buckets that grow with the value, as
+// in HdrHistogram: values below 16 get a bucket each, and every larger power
+// of two range is split into 16 equal buckets, so a percentile is reported
+// with at most 1/16 relative error.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    void Record(uint64_t nanoseconds, uint64_t count = 1);
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t GetCount() const;
+    uint64_t GetTotal() const;
+    uint64_t GetMax() const;
+    // Upper bound of the bucket that holds the given share of the values; 0 when empty
+    uint64_t GetPercentile(double fraction) const;
+
+    static size_t GetBucket(uint64_t nanoseconds);
+    static uint64_t GetBucketUpperBound(size_t bucket);
+
+private:
+    std::array<uint64_t, BUCKET_COUNT> buckets_{};
+    uint64_t count_ = 0;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+
+    friend struct ThreadQueryStats;
+};
+
+
+struct QueryStatsSnapshot {
+    std::array<LatencyHistogram, QUERY_STAGE_COUNT> stages;
+    std::array<uint64_t, QUERY_COUNTER_COUNT> counters{};
+
+    const LatencyHistogram& GetStage(QueryStage stage) const;
+    uint64_t GetCounter(QueryCounter counter) const;
+};
+
+void EnableQueryStats(bool enabled);
+bool IsQueryStatsEnabled();
+// Sums the records of all threads, including finished ones. Records made
+// while the snapshot is taken may or may not be in it
+QueryStatsSnapshot GetQueryStats();
+void ResetQueryStats();
+
+void AddQueryCounter(QueryCounter counter, uint64_t value);
+
+
+// Records the time from construction to destruction as one run of the stage
+class QueryStageTimer {
+public:
+    explicit QueryStageTimer(QueryStage stage);
+    ~QueryStageTimer();
+
+    QueryStageTimer(const QueryStageTimer&) = delete;
+    QueryStageTimer& operator=(const QueryStageTimer&) = delete;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    QueryStage stage_;
+    bool enabled_;
+    Clock::time_point start_;
+};
+
+
+// Adds up a stage that runs in pieces between other stages, each from Resume
+// to Pause, and records the sum as one run on destruction
+class QueryStageStopwatch {
+public:
+    explicit QueryStageStopwatch(QueryStage stage);
+    ~QueryStageStopwatch();
+
+    QueryStageStopwatch(const QueryStageStopwatch&) = delete;
+    QueryStageStopwatch& operator=(const QueryStageStopwatch&) = delete;
+
+    void Resume();
+    void Pause();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    QueryStage stage_;
+    bool enabled_;
+    Clock::time_point start_;
+    Clock::duration total_{};
+};
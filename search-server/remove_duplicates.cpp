@@ -1,22 +1,96 @@
 #include "remove_duplicates.h"
 
+#include <algorithm>
+#include <execution>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "hash_utils.h"
+
+using namespace std;
+
+
+namespace {
+
+struct Fingerprint {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool operator==(const Fingerprint& other) const {
+        return high == other.high && low == other.low;
+    }
+    bool operator<(const Fingerprint& other) const {
+        return high < other.high || (high == other.high && low < other.low);
+    }
+};
+
+// 128-bit hash of the set of words of a document. Word hashes are summed, so
+// the order of the words does not matter
+Fingerprint ComputeFingerprint(const map<string_view, double>& word_frequencies) {
+    Fingerprint fingerprint;
+    for (const auto& [word, freq] : word_frequencies) {
+        const uint64_t word_hash = hash<string_view>{}(word);
+        fingerprint.high += Mix(word_hash);
+        fingerprint.low += Mix(word_hash ^ 0x9e3779b97f4a7c15ULL);
+    }
+    fingerprint.low ^= word_frequencies.size();
+    return fingerprint;
+}
+
+bool HaveSameWords(const map<string_view, double>& lhs, const map<string_view, double>& rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const auto& lhs_entry, const auto& rhs_entry) {
+        return lhs_entry.first == rhs_entry.first;
+    });
+}
+
+}  // namespace
+
+
 void RemoveDuplicates(SearchServer& search_server){
+    struct DocumentFingerprint {
+        Fingerprint fingerprint;
+        int document_id;
+    };
+    vector<DocumentFingerprint> documents;
+    documents.reserve(search_server.GetDocumentCount());
+    for (const int document_id : search_server) {
+        documents.push_back({{}, document_id});
+    }
+    for_each(execution::par, documents.begin(), documents.end(), [&search_server](DocumentFingerprint& document) {
+        document.fingerprint = ComputeFingerprint(search_server.GetWordFrequencies(document.document_id));
+    });
+    // Within a run of equal fingerprints the lowest id comes first and is kept
+    sort(execution::par, documents.begin(), documents.end(), [](const DocumentFingerprint& lhs, const DocumentFingerprint& rhs) {
+        return lhs.fingerprint < rhs.fingerprint || (lhs.fingerprint == rhs.fingerprint && lhs.document_id < rhs.document_id);
+    });
+
     vector<int> remove_docs;
-    set<set<string>> unique_docs_words;
-    for (const int &document_id : search_server) {
-        set<string> words;
-        for(const auto [word, freq] : search_server.GetWordFrequencies(document_id)){
-            words.insert(word);
+    // Documents of the current run whose words differ from all earlier ones in it
+    vector<int> kept_ids;
+    for (size_t begin = 0, end = 0; begin < documents.size(); begin = end) {
+        end = begin + 1;
+        while (end < documents.size() && documents[end].fingerprint == documents[begin].fingerprint) {
+            ++end;
         }
-        if(unique_docs_words.find(words) == unique_docs_words.end()){
-            unique_docs_words.insert(words);
-        }else{
-            remove_docs.emplace_back(document_id);
+        kept_ids.assign(1, documents[begin].document_id);
+        for (size_t i = begin + 1; i < end; ++i) {
+            const int document_id = documents[i].document_id;
+            const auto& words = search_server.GetWordFrequencies(document_id);
+            // Equal fingerprints almost always mean equal words; a collision keeps both documents
+            if (any_of(kept_ids.begin(), kept_ids.end(), [&](int kept_id) {
+                return HaveSameWords(search_server.GetWordFrequencies(kept_id), words);
+            })) {
+                remove_docs.push_back(document_id);
+            } else {
+                kept_ids.push_back(document_id);
+            }
         }
-        
     }
+
+    sort(remove_docs.begin(), remove_docs.end());
     for (const auto& id : remove_docs){
         std::cout << "Found duplicate document id "s << id << '\n';
-        search_server.RemoveDocument(id);
     }
-}
\ No newline at end of file
+    search_server.RemoveDocuments(remove_docs);
+}
@@ -1,45 +1,107 @@
 #include <execution>
+#include <thread>
 
 #include "request_queue.h"
 
 
 using namespace std;
 
-RequestQueue::RequestQueue(const SearchServer& search_server)
+RequestQueue::RequestQueue(const SearchServer& search_server, Clock::duration window)
     : search_server_(search_server)
-    , no_results_requests_(0)
-    , current_time_(0) {}
+    , start_time_(Clock::now())
+    , window_(max(window, Clock::duration(SLOT_COUNT)))
+    , slot_duration_(window_ / SLOT_COUNT)
+    , slots_(SLOT_COUNT) {}
 
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
+    const auto start_time = Clock::now();
     const auto result = search_server_.FindTopDocuments(raw_query, status);
-    AddRequest(result.size());
+    AddRequest(result.size(), Clock::now() - start_time);
     return result;
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
+    const auto start_time = Clock::now();
     const auto result = search_server_.FindTopDocuments(raw_query);
-    AddRequest(result.size());
+    AddRequest(result.size(), Clock::now() - start_time);
     return result;
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    return no_results_requests_;
+    uint64_t no_result_requests = 0;
+    ForEachSlotInWindow([&no_result_requests](const Slot& slot) {
+        no_result_requests += slot.no_result_requests.load(memory_order_relaxed);
+    });
+    return static_cast<int>(no_result_requests);
 }
 
-void RequestQueue::AddRequest(int results_num) {
-    // новый запрос - новая секунда
-    ++current_time_;
-    // удаляем все результаты поиска, которые устарели
-    while (!requests_.empty() && min_in_day_ <= current_time_ - requests_.front().timestamp) {
-        if (0 == requests_.front().results) {
-            --no_results_requests_;
+RequestWindowStats RequestQueue::GetWindowStats() const {
+    RequestWindowStats stats;
+    ForEachSlotInWindow([&stats](const Slot& slot) {
+        stats.requests += slot.requests.load(memory_order_relaxed);
+        stats.no_result_requests += slot.no_result_requests.load(memory_order_relaxed);
+        for (size_t bucket = 0; bucket < LatencyHistogram::BUCKET_COUNT; ++bucket) {
+            const uint64_t count = slot.latencies[bucket].load(memory_order_relaxed);
+            if (count > 0) {
+                stats.latencies.Record(LatencyHistogram::GetBucketUpperBound(bucket), count);
+            }
+        }
+    });
+    // A young queue has not seen a whole window yet
+    const auto covered = min(window_, Clock::now() - start_time_);
+    const double seconds = chrono::duration<double>(covered).count();
+    stats.requests_per_second = seconds > 0 ? stats.requests / seconds : 0.0;
+    return stats;
+}
+
+QueryCacheStats RequestQueue::GetCacheStats() const {
+    return search_server_.GetQueryCacheStats();
+}
+
+int64_t RequestQueue::GetPeriod(Clock::time_point time) const {
+    return (time - start_time_) / slot_duration_;
+}
+
+void RequestQueue::AddRequest(size_t results_num, Clock::duration latency) {
+    const int64_t period = GetPeriod(Clock::now());
+    Slot& slot = slots_[period % SLOT_COUNT];
+    int64_t epoch = slot.epoch.load(memory_order_acquire);
+    while (epoch != period) {
+        if (epoch > period) {
+            // The thread was delayed past a whole window; the request is already outdated
+            return;
+        }
+        if (epoch == RECYCLING) {
+            this_thread::yield();
+            epoch = slot.epoch.load(memory_order_acquire);
+        } else if (slot.epoch.compare_exchange_weak(epoch, RECYCLING, memory_order_acquire)) {
+            slot.requests.store(0, memory_order_relaxed);
+            slot.no_result_requests.store(0, memory_order_relaxed);
+            for (atomic<uint64_t>& count : slot.latencies) {
+                count.store(0, memory_order_relaxed);
+            }
+            slot.epoch.store(period, memory_order_release);
+            break;
         }
-        requests_.pop_front();
     }
-    // сохраняем новый результат поиска
-    requests_.push_back({current_time_, results_num});
+
+    const auto nanoseconds = chrono::duration_cast<chrono::nanoseconds>(latency).count();
+    slot.requests.fetch_add(1, memory_order_relaxed);
     if (0 == results_num) {
-        ++no_results_requests_;
+        slot.no_result_requests.fetch_add(1, memory_order_relaxed);
+    }
+    slot.latencies[LatencyHistogram::GetBucket(static_cast<uint64_t>(max<int64_t>(nanoseconds, 0)))]
+        .fetch_add(1, memory_order_relaxed);
+}
+
+template <typename Func>
+void RequestQueue::ForEachSlotInWindow(Func func) const {
+    const int64_t current_period = GetPeriod(Clock::now());
+    for (const Slot& slot : slots_) {
+        const int64_t epoch = slot.epoch.load(memory_order_acquire);
+        if (epoch > current_period - static_cast<int64_t>(SLOT_COUNT) && epoch <= current_period && epoch >= 0) {
+            func(slot);
+        }
     }
 }
@@ -1,19 +1,50 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <execution>
 #include <stdexcept>
-#include <deque>
 #include <string>
 #include <vector>
 
 #include "search_server.h"
 #include "document.h"
+#include "query_stats.h"
 
 
+// Requests recorded in the current window of a RequestQueue
+struct RequestWindowStats {
+    uint64_t requests = 0;
+    uint64_t no_result_requests = 0;
+    double requests_per_second = 0.0;
+    // Time spent in FindTopDocuments, in nanoseconds
+    LatencyHistogram latencies;
+};
+
+
+// Runs searches and keeps statistics over the requests of a sliding time
+// window. Any number of threads may add requests and read the statistics
+// concurrently.
+//
+// The window is split into SLOT_COUNT slots of a ring buffer, each holding
+// the counters of one slot-long period, so the window moves one slot at a
+// time. Recording a request takes a few relaxed atomic increments; the first
+// request of a period also zeroes the slot it reuses, and requests racing
+// with it wait until that is done. Statistics read while requests are being
+// recorded may count some of those requests and not others.
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t SLOT_COUNT = 32;
+
+    explicit RequestQueue(const SearchServer& search_server, Clock::duration window = std::chrono::hours(24));
+
+    RequestQueue(const RequestQueue&) = delete;
+    RequestQueue& operator=(const RequestQueue&) = delete;
 
     // сделаем "обертки" для всех методов поиска, чтобы сохранять результаты для нашей статистики
     template <typename DocumentPredicate>
@@ -21,28 +52,43 @@ public:
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(const std::string& raw_query);
 
+    // Within the window
     int GetNoResultRequests() const;
+    RequestWindowStats GetWindowStats() const;
+    // Requests filtered by status are answered from the server's query cache when it is enabled
+    QueryCacheStats GetCacheStats() const;
 
 private:
-    struct QueryResult {
-        uint64_t timestamp;
-        int results;
+    // Slot epochs that are not a period
+    static constexpr int64_t EMPTY = -1;
+    static constexpr int64_t RECYCLING = -2;
+
+    struct Slot {
+        // Period whose requests the slot counts
+        std::atomic<int64_t> epoch{EMPTY};
+        std::atomic<uint64_t> requests{0};
+        std::atomic<uint64_t> no_result_requests{0};
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT> latencies{};
     };
 
-    std::deque<QueryResult> requests_;
     const SearchServer& search_server_;
-    int no_results_requests_;
-    uint64_t current_time_;
-    const static int min_in_day_ = 1440;
-
-    void AddRequest(int results_num);
-
+    const Clock::time_point start_time_;
+    const Clock::duration window_;
+    const Clock::duration slot_duration_;
+    std::vector<Slot> slots_;
 
+    // Index of the slot-long period since start_time_
+    int64_t GetPeriod(Clock::time_point time) const;
+    void AddRequest(size_t results_num, Clock::duration latency);
+    // Calls func(slot) for every slot of the window
+    template <typename Func>
+    void ForEachSlotInWindow(Func func) const;
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue:: AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+    const auto start_time = Clock::now();
     const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
-    AddRequest(result.size());
+    AddRequest(result.size(), Clock::now() - start_time);
     return result;
 }
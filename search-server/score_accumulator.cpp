@@ -0,0 +1,50 @@
+#include "score_accumulator.h"
+
+using namespace std;
+
+
+void ScoreAccumulator::Add(int document_id, double value) {
+    Page& page = TouchPage(document_id >> PAGE_BITS);
+    const int index = document_id & (PAGE_SIZE - 1);
+    if (page.states[index] == State::EMPTY) {
+        page.states[index] = State::SCORED;
+        page.scores[index] = value;
+    } else if (page.states[index] == State::SCORED) {
+        page.scores[index] += value;
+    }
+}
+
+void ScoreAccumulator::Exclude(int document_id) {
+    TouchPage(document_id >> PAGE_BITS).states[document_id & (PAGE_SIZE - 1)] = State::EXCLUDED;
+}
+
+bool ScoreAccumulator::IsExcluded(int document_id) const {
+    const size_t page_index = document_id >> PAGE_BITS;
+    if (page_index >= pages_.size() || !pages_[page_index] || !pages_[page_index]->touched) {
+        return false;
+    }
+    return pages_[page_index]->states[document_id & (PAGE_SIZE - 1)] == State::EXCLUDED;
+}
+
+void ScoreAccumulator::Clear() {
+    for (const int page_index : touched_pages_) {
+        pages_[page_index]->touched = false;
+    }
+    touched_pages_.clear();
+}
+
+ScoreAccumulator::Page& ScoreAccumulator::TouchPage(int page_index) {
+    if (page_index >= static_cast<int>(pages_.size())) {
+        pages_.resize(page_index + 1);
+    }
+    auto& page = pages_[page_index];
+    if (!page) {
+        page = make_unique<Page>();
+    }
+    if (!page->touched) {
+        page->touched = true;
+        fill(begin(page->states), end(page->states), State::EMPTY);
+        touched_pages_.push_back(page_index);
+    }
+    return *page;
+}
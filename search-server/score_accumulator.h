@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// Relevance accumulator indexed by internal document id. Memory is split into
+// fixed-size pages that are allocated on first touch and kept for reuse, so
+// resetting between queries only costs as much as the previous query touched.
+class ScoreAccumulator {
+public:
+    void Add(int document_id, double value);
+    // Drops the document from the results; later Add calls for it are ignored
+    void Exclude(int document_id);
+    bool IsExcluded(int document_id) const;
+
+    // Calls func(document_id, relevance) in ascending document id order for every scored, non-excluded document
+    template <typename Func>
+    void ForEach(Func func);
+
+    void Clear();
+
+private:
+    static const int PAGE_BITS = 8;
+    static const int PAGE_SIZE = 1 << PAGE_BITS;
+
+    enum class State : uint8_t {
+        EMPTY,
+        SCORED,
+        EXCLUDED,
+    };
+
+    struct Page {
+        double scores[PAGE_SIZE];
+        State states[PAGE_SIZE];
+        // States of an untouched page are left over from earlier queries
+        bool touched = false;
+    };
+
+    std::vector<std::unique_ptr<Page>> pages_;
+    std::vector<int> touched_pages_;
+
+    Page& TouchPage(int page_index);
+};
+
+
+template <typename Func>
+void ScoreAccumulator::ForEach(Func func) {
+    std::sort(touched_pages_.begin(), touched_pages_.end());
+    for (const int page_index : touched_pages_) {
+        const Page& page = *pages_[page_index];
+        for (int i = 0; i < PAGE_SIZE; ++i) {
+            if (page.states[i] == State::SCORED) {
+                func((page_index << PAGE_BITS) + i, page.scores[i]);
+            }
+        }
+    }
+}
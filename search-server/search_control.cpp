@@ -0,0 +1,41 @@
+#include "search_control.h"
+
+using namespace std;
+
+
+CancellationToken::CancellationToken()
+    : cancelled_(make_shared<atomic<bool>>(false)) {
+}
+
+void CancellationToken::Cancel() {
+    cancelled_->store(true, memory_order_relaxed);
+}
+
+bool CancellationToken::IsCancelled() const {
+    return cancelled_->load(memory_order_relaxed);
+}
+
+
+SearchControl::SearchControl(Clock::time_point deadline, CancellationToken token)
+    : deadline_(deadline)
+    , token_(move(token)) {
+}
+
+bool SearchControl::ShouldStop() {
+    if (status_ != SearchStatus::COMPLETED) {
+        return true;
+    }
+    if (calls_++ % CHECK_INTERVAL != 0) {
+        return false;
+    }
+    if (token_.IsCancelled()) {
+        status_ = SearchStatus::CANCELLED;
+    } else if (Clock::now() >= deadline_) {
+        status_ = SearchStatus::TIMED_OUT;
+    }
+    return status_ != SearchStatus::COMPLETED;
+}
+
+SearchStatus SearchControl::GetStatus() const {
+    return status_;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+
+// Asks the searches it was handed to stop. Copies share one flag, so the
+// caller keeps a copy and cancels it from any thread.
+class CancellationToken {
+public:
+    CancellationToken();
+
+    void Cancel();
+    bool IsCancelled() const;
+
+private:
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+
+// How a search ended
+enum class SearchStatus {
+    COMPLETED,
+    TIMED_OUT,
+    CANCELLED,
+};
+
+
+// Deadline and cancellation token of one search, polled while it scores
+class SearchControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit SearchControl(Clock::time_point deadline, CancellationToken token = {});
+
+    // True once the deadline has passed or the token was cancelled. Only
+    // every CHECK_INTERVAL-th call looks at the clock and the token, the
+    // first one included, so it is cheap enough for a scoring loop
+    bool ShouldStop();
+    // COMPLETED until ShouldStop has returned true
+    SearchStatus GetStatus() const;
+
+private:
+    static const uint32_t CHECK_INTERVAL = 256;
+
+    Clock::time_point deadline_;
+    CancellationToken token_;
+    uint32_t calls_ = 0;
+    SearchStatus status_ = SearchStatus::COMPLETED;
+};
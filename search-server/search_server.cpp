@@ -14,33 +14,230 @@ SearchServer::SearchServer(const string& stop_words_text)
 
 
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || (external_to_internal_ids_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
-    const auto words = SplitIntoWordsNoStop(document);
+    // Reused between calls on the same thread
+    thread_local vector<string_view> words;
+    thread_local vector<int> term_ids;
+    SplitIntoWordsNoStop(document, words);
+    const int internal_id = static_cast<int>(external_ids_.size());
 
-    const double inv_word_count = 1.0 / words.size();
+    term_ids.clear();
     for (const string_view word : words) {
-        word_to_document_freqs_[string(word)][document_id] += inv_word_count;
-        id_word_frequencies_[document_id][word] += inv_word_count;
+        term_ids.push_back(InsertTerm(word));
     }
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status});
+    sort(term_ids.begin(), term_ids.end());
+
+    const int word_count = static_cast<int>(words.size());
+    map<string_view, double> word_frequencies;
+    for (auto it = term_ids.begin(); it != term_ids.end();) {
+        const auto run_end = upper_bound(it, term_ids.end(), *it);
+        const uint32_t count = static_cast<uint32_t>(run_end - it);
+        const double term_freq = count * 1.0 / word_count;
+        term_postings_[*it].Add(internal_id, count, term_freq);
+        // Key by the interned copy so the view outlives the caller's buffer
+        word_frequencies.emplace(terms_.GetTerm(*it), term_freq);
+        it = run_end;
+    }
+
+    external_to_internal_ids_.emplace(document_id, internal_id);
+    external_ids_.push_back(document_id);
+    ratings_.push_back(ComputeAverageRating(ratings));
+    statuses_.push_back(status);
+    word_counts_.push_back(word_count);
+    word_frequencies_.push_back(move(word_frequencies));
     document_ids_.insert(document_id);
+    tombstones_.push_back(false);
+    BumpIndexEpoch();
 }
 
 
-vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const { //***
-    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    // Index of the first document whose AddDocument call would throw, and its exception
+    size_t first_error_index = documents.size();
+    exception_ptr first_error;
+    set<int> batch_ids;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int document_id = documents[i].id;
+        if (document_id < 0 || external_to_internal_ids_.count(document_id) > 0 || !batch_ids.insert(document_id).second) {
+            first_error_index = i;
+            first_error = make_exception_ptr(invalid_argument("Invalid document_id"s));
+            break;
+        }
+    }
+
+    // Every chunk builds a local index of its own
+    const size_t min_chunk_size = 256;
+    const size_t chunk_count = clamp<size_t>(documents.size() / min_chunk_size, 1, max(1u, thread::hardware_concurrency()));
+    vector<SearchServer> chunk_servers;
+    chunk_servers.reserve(chunk_count);
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        chunk_servers.emplace_back(stop_words_);
+    }
+    vector<size_t> chunk_error_indexes(chunk_count, documents.size());
+    vector<exception_ptr> chunk_errors(chunk_count);
+    vector<size_t> chunks(chunk_count);
+    iota(chunks.begin(), chunks.end(), 0);
+    for_each(execution::par, chunks.begin(), chunks.end(), [&](size_t chunk) {
+        const size_t first = documents.size() * chunk / chunk_count;
+        // Nothing after a known error can be added anyway
+        const size_t last = min(documents.size() * (chunk + 1) / chunk_count, first_error_index);
+        for (size_t i = first; i < last; ++i) {
+            const NewDocument& document = documents[i];
+            try {
+                chunk_servers[chunk].AddDocument(document.id, document.text, document.status, document.ratings);
+            } catch (...) {
+                chunk_error_indexes[chunk] = i;
+                chunk_errors[chunk] = current_exception();
+                return;
+            }
+        }
     });
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        if (chunk_error_indexes[chunk] < first_error_index) {
+            first_error_index = chunk_error_indexes[chunk];
+            first_error = chunk_errors[chunk];
+        }
+    }
+    if (first_error) {
+        rethrow_exception(first_error);
+    }
+
+    for (const SearchServer& chunk_server : chunk_servers) {
+        AppendDocuments(chunk_server, {});
+    }
+}
+
+
+void SearchServer::AppendDocuments(const SearchServer& other, const set<int>& skipped_ids) {
+    for (const auto [document_id, other_id] : other.external_to_internal_ids_) {
+        if (skipped_ids.count(document_id) == 0 && external_to_internal_ids_.count(document_id) > 0) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+    }
+
+    // Keeping the relative order of the documents keeps the new posting entries sorted
+    vector<int> new_internal_ids(other.external_ids_.size(), NO_DOCUMENT);
+    for (int other_id = 0; other_id < static_cast<int>(other.external_ids_.size()); ++other_id) {
+        const int document_id = other.external_ids_[other_id];
+        if (other.FindInternalId(document_id) != other_id || skipped_ids.count(document_id) > 0) {
+            continue;
+        }
+        const int internal_id = static_cast<int>(external_ids_.size());
+        new_internal_ids[other_id] = internal_id;
+
+        other.EnsureWordFrequencies(other_id);
+        map<string_view, double> word_frequencies;
+        for (const auto [word, term_freq] : other.word_frequencies_[other_id]) {
+            word_frequencies.emplace(terms_.GetTerm(InsertTerm(word)), term_freq);
+        }
+        external_to_internal_ids_.emplace(document_id, internal_id);
+        external_ids_.push_back(document_id);
+        ratings_.push_back(other.ratings_[other_id]);
+        statuses_.push_back(other.statuses_[other_id]);
+        word_counts_.push_back(other.word_counts_[other_id]);
+        word_frequencies_.push_back(move(word_frequencies));
+        document_ids_.insert(document_id);
+        tombstones_.push_back(false);
+    }
+
+    for (int other_term_id = 0; other_term_id < other.terms_.size(); ++other_term_id) {
+        const PostingList& other_postings = other.term_postings_[other_term_id];
+        if (other_postings.empty()) {
+            continue;
+        }
+        PostingList& postings = term_postings_[InsertTerm(other.terms_.GetTerm(other_term_id))];
+        other_postings.ForEach([&](int other_id, uint32_t count) {
+            const int internal_id = new_internal_ids[other_id];
+            if (internal_id != NO_DOCUMENT) {
+                postings.Add(internal_id, count, count * 1.0 / word_counts_[internal_id]);
+            }
+        });
+    }
+    BumpIndexEpoch();
+}
+
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t max_result_count) const { //***
+    const auto document_predicate = [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    };
+    if (!query_cache_) {
+        return FindTopDocuments(raw_query, document_predicate, max_result_count);
+    }
+
+    const auto query = ParseQuery(raw_query);
+    const string key = MakeQueryCacheKey(query, status, max_result_count);
+    vector<Document> documents;
+    if (query_cache_->Find(key, index_epoch_, documents)) {
+        return documents;
+    }
+    documents = FindParsedTopDocuments(query, document_predicate, max_result_count);
+    query_cache_->Insert(key, index_epoch_, documents);
+    return documents;
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t max_result_count,
+                                                SearchControl& control) const {
+    // A search that waited past its deadline does no work at all
+    if (control.ShouldStop()) {
+        return {};
+    }
+    const auto query = ParseQuery(raw_query);
+    TopDocumentsCollector collector(max_result_count);
+    CollectTopDocuments(query, ComputeInverseDocumentFreqs(query),
+                        [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    }, collector, &control);
+    QueryStageTimer timer(QueryStage::MATERIALIZE);
+    return collector.Release();
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const { //***
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries, DocumentStatus status,
+                                                            size_t max_result_count) const {
+    return FindTopDocumentsBatch(raw_queries, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    }, max_result_count);
+}
+
+QueryResults SearchServer::FindTopDocumentsBatchFlat(const vector<string>& raw_queries, DocumentStatus status,
+                                                     size_t max_result_count) const {
+    return FindTopDocumentsBatchFlat(raw_queries, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    }, max_result_count);
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return external_to_internal_ids_.size();
+}
+
+bool SearchServer::HasDocument(int document_id) const {
+    return FindInternalId(document_id) != NO_DOCUMENT;
+}
+
+void SearchServer::SetQueryEngine(QueryEngine engine) {
+    query_engine_ = engine;
+}
+
+QueryEngine SearchServer::GetQueryEngine() const {
+    return query_engine_;
+}
+
+void SearchServer::EnableQueryCache(size_t capacity) {
+    query_cache_ = make_unique<QueryResultCache>(capacity);
+}
+
+void SearchServer::DisableQueryCache() {
+    query_cache_.reset();
+}
+
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+    return query_cache_ ? query_cache_->GetStats() : QueryCacheStats{};
 }
 
 const set<int>::const_iterator SearchServer::begin() const {
@@ -53,46 +250,54 @@ const set<int>::const_iterator SearchServer::end() const {
 
 const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
     static const map<string_view, double> get_map;
-    if (id_word_frequencies_.count(document_id)) {
-        return id_word_frequencies_.at(document_id);
+    const int internal_id = FindInternalId(document_id);
+    if (internal_id != NO_DOCUMENT) {
+        EnsureWordFrequencies(internal_id);
+        return word_frequencies_[internal_id];
     }
     return get_map;
 }
 
 void SearchServer::RemoveDocument(int document_id){
-    const auto doc_found_it = find(document_ids_.begin(), document_ids_.end(), document_id);
-    //const auto doc_found_it = document_ids_.find(document_id);
-
-    if (doc_found_it == document_ids_.end()) {
+    const auto it = external_to_internal_ids_.find(document_id);
+    if (it == external_to_internal_ids_.end()) {
         return;
     }
+    const int internal_id = it->second;
+
+    external_to_internal_ids_.erase(it);
+    document_ids_.erase(document_id);
+    tombstones_[internal_id] = true;
+    pending_removed_ids_.push_back(internal_id);
+    BumpIndexEpoch();
+
+    // Keeps document counts exact for IDF without touching the postings
+    EnsureWordFrequencies(internal_id);
+    for (const auto& [word, term_freq] : word_frequencies_[internal_id]) {
+        ++term_tombstone_counts_[terms_.Find(word)];
+    }
+}
 
-    document_ids_.erase(doc_found_it);
-    documents_.erase(document_id);
 
-    for (auto& [word, d] : id_word_frequencies_.at(document_id)) {
-        word_to_document_freqs_.at(string(word)).erase(document_id);
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    for (const int document_id : document_ids) {
+        RemoveDocument(document_id);
     }
-
-    id_word_frequencies_.erase(document_id);
+    Compact(execution::par);
 }
 
+void SearchServer::Compact() {
+    Compact(execution::seq);
+}
 
 void SearchServer::RemoveDocument(const execution::sequenced_policy&, int document_id) {
     RemoveDocument(document_id);
 }
 
 void SearchServer::RemoveDocument(const execution::parallel_policy&, int document_id) {
-        if (documents_.count(document_id) == 0) {
-            return;
-        }
-
-        documents_.erase(document_id);
-        auto it = std::find(execution::par, document_ids_.begin(), document_ids_.end(), document_id);
-        if (it != document_ids_.end()) {
-            document_ids_.erase(it);
-        }
-    }
+    // Removal only sets a tombstone, which leaves nothing to parallelize
+    RemoveDocument(document_id);
+}
 
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
@@ -101,47 +306,62 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_vi
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy&, string_view raw_query, int document_id) const {
     std::vector<std::string_view> matched_words;
-    if ((document_id < 0) || (documents_.count(document_id)==0)) {
+    const int internal_id = FindInternalId(document_id);
+    if (internal_id == NO_DOCUMENT) {
         throw invalid_argument("Invalid document_id"s);
     }
     if (!IsValidWord(raw_query)) {
         throw invalid_argument("Some of query words are invalid"s);
     }
     const auto query = ParseQuery(raw_query);
-    for (const string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(string(word)) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-            return { matched_words, documents_.at(document_id).status };
+    {
+        QueryStageTimer timer(QueryStage::MINUS_FILTER);
+        for (const string_view word : query.minus_words) {
+            const int term_id = terms_.Find(word);
+            if (term_id == TermDictionary::NO_TERM) {
+                continue;
+            }
+            if (term_postings_[term_id].Contains(internal_id)) {
+                return { matched_words, statuses_[internal_id] };
+            }
         }
     }
 
+    QueryStageTimer timer(QueryStage::POSTING_TRAVERSAL);
     for (std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(string(word)) == 0) {
+        const int term_id = terms_.Find(word);
+        if (term_id == TermDictionary::NO_TERM) {
             continue;
         }
-        if (word_to_document_freqs_.at(string(word)).count(document_id)) {
+        if (term_postings_[term_id].Contains(internal_id)) {
             matched_words.push_back(word);
         }
     }
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, statuses_[internal_id]};
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, string_view raw_query, int document_id) const {
     const auto query = ParseQuery(raw_query, true);
     vector<string_view> matched_words;
-    const auto status = documents_.at(document_id).status;
+    const int internal_id = external_to_internal_ids_.at(document_id);
+    const auto status = statuses_[internal_id];
+    CheckPostings(query.plus_words);
+    CheckPostings(query.minus_words);
     const auto word_checker   =
-        [this, document_id](const string_view word) {
-        const auto it = word_to_document_freqs_.find(string(word));
-        return it != word_to_document_freqs_.end() && it->second.count(document_id);
+        [this, internal_id](const string_view word) {
+        const int term_id = terms_.Find(word);
+        return term_id != TermDictionary::NO_TERM && term_postings_[term_id].Contains(internal_id);
     };
-    if (any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), word_checker )) {
-        return { matched_words, status };
+    {
+        QueryStageTimer timer(QueryStage::MINUS_FILTER);
+        if (any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), word_checker )) {
+            return { matched_words, status };
+        }
     }
 
-    matched_words.reserve(query.plus_words.size());
+    QueryStageTimer timer(QueryStage::POSTING_TRAVERSAL);
+    // copy_if writes through the iterator, so the elements must exist
+    matched_words.resize(query.plus_words.size());
     auto words_end = copy_if(execution::par, query.plus_words.begin(), query.plus_words.end(),
         matched_words.begin(), word_checker
     );
@@ -152,29 +372,331 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const exe
     return { matched_words, status };
 }
 
+void SearchServer::MatchDocuments(string_view raw_query, MatchResults& results) const {
+    MatchDocuments(raw_query, vector<int>(document_ids_.begin(), document_ids_.end()), results);
+}
+
+void SearchServer::MatchDocuments(string_view raw_query, const vector<int>& document_ids, MatchResults& results) const {
+    if (!IsValidWord(raw_query)) {
+        throw invalid_argument("Some of query words are invalid"s);
+    }
+    vector<int> internal_ids;
+    internal_ids.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        const int internal_id = FindInternalId(document_id);
+        if (internal_id == NO_DOCUMENT) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        internal_ids.push_back(internal_id);
+    }
+    const auto query = ParseQuery(raw_query);
+    // Plus words stay in the sorted order MatchDocument returns them in
+    vector<string_view> plus_words;
+    vector<int> plus_term_ids;
+    for (const string_view word : query.plus_words) {
+        const int term_id = terms_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            plus_words.push_back(word);
+            plus_term_ids.push_back(term_id);
+        }
+    }
+    vector<int> minus_term_ids;
+    for (const string_view word : query.minus_words) {
+        const int term_id = terms_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            minus_term_ids.push_back(term_id);
+        }
+    }
+    CheckPostings(plus_term_ids);
+    CheckPostings(minus_term_ids);
+
+    const size_t document_count = internal_ids.size();
+    const size_t word_count = plus_words.size();
+    vector<size_t> chunk_starts;
+    for (size_t start = 0; start < document_count; start += MATCH_CHUNK_SIZE) {
+        chunk_starts.push_back(start);
+    }
+    // contains[i * word_count + j] is set if document i has plus word j and no minus word
+    vector<char> contains(document_count * word_count, 0);
+    vector<size_t> match_counts(document_count, 0);
+    for_each(execution::par, chunk_starts.begin(), chunk_starts.end(), [&](size_t chunk_start) {
+        const size_t chunk_end = min(chunk_start + MATCH_CHUNK_SIZE, document_count);
+        // Visiting the documents in internal id order lets every cursor only move forward
+        vector<size_t> order(chunk_end - chunk_start);
+        iota(order.begin(), order.end(), chunk_start);
+        sort(order.begin(), order.end(), [&internal_ids](size_t lhs, size_t rhs) {
+            return internal_ids[lhs] < internal_ids[rhs];
+        });
+        const auto for_each_posting = [&](int term_id, auto func) {
+            PostingList::Cursor cursor(term_postings_[term_id]);
+            for (const size_t i : order) {
+                cursor.NextGeq(internal_ids[i]);
+                if (cursor.GetDocumentId() == PostingList::Cursor::END) {
+                    break;
+                }
+                if (cursor.GetDocumentId() == internal_ids[i]) {
+                    func(i);
+                }
+            }
+        };
+
+        vector<char> has_minus_word(chunk_end - chunk_start, 0);
+        {
+            QueryStageTimer timer(QueryStage::MINUS_FILTER);
+            for (const int term_id : minus_term_ids) {
+                for_each_posting(term_id, [&](size_t i) {
+                    has_minus_word[i - chunk_start] = 1;
+                });
+            }
+        }
+        QueryStageTimer timer(QueryStage::POSTING_TRAVERSAL);
+        for (size_t j = 0; j < word_count; ++j) {
+            for_each_posting(plus_term_ids[j], [&](size_t i) {
+                if (!has_minus_word[i - chunk_start]) {
+                    contains[i * word_count + j] = 1;
+                    ++match_counts[i];
+                }
+            });
+        }
+    });
+
+    QueryStageTimer timer(QueryStage::MATERIALIZE);
+    results.clear();
+    results.document_ids_.assign(document_ids.begin(), document_ids.end());
+    results.statuses_.reserve(document_count);
+    results.offsets_.reserve(document_count + 1);
+    for (size_t i = 0; i < document_count; ++i) {
+        results.statuses_.push_back(statuses_[internal_ids[i]]);
+        results.offsets_.push_back(results.offsets_.back() + match_counts[i]);
+    }
+    results.words_.resize(results.offsets_.back());
+    for_each(execution::par, chunk_starts.begin(), chunk_starts.end(), [&](size_t chunk_start) {
+        const size_t chunk_end = min(chunk_start + MATCH_CHUNK_SIZE, document_count);
+        for (size_t i = chunk_start; i < chunk_end; ++i) {
+            size_t position = results.offsets_[i];
+            for (size_t j = 0; j < word_count; ++j) {
+                if (contains[i * word_count + j]) {
+                    results.words_[position++] = plus_words[j];
+                }
+            }
+        }
+    });
+}
+
+
+void SearchServer::SaveIndex(const string& path) const {
+    IndexFileWriter writer(path);
+    writer.WriteStrings(stop_words_);
+    // Lets the postings be checked against it on loading
+    writer.Write(static_cast<int32_t>(external_ids_.size()));
+    terms_.Save(writer);
+    for (int term_id = 0; term_id < terms_.size(); ++term_id) {
+        const PostingList& postings = term_postings_[term_id];
+        if (term_tombstone_counts_[term_id] == 0) {
+            postings.Save(writer);
+            continue;
+        }
+        // Removed documents are left out rather than stored as tombstones
+        PostingList live_postings;
+        postings.ForEach([&](int id, uint32_t count) {
+            if (!tombstones_[id]) {
+                live_postings.Add(id, count, count * 1.0 / word_counts_[id]);
+            }
+        });
+        live_postings.Save(writer);
+    }
+
+    vector<uint8_t> live(external_ids_.size(), 0);
+    for (const auto [document_id, internal_id] : external_to_internal_ids_) {
+        live[internal_id] = 1;
+    }
+    writer.WriteArray(external_ids_.data(), external_ids_.size());
+    writer.WriteArray(ratings_.data(), ratings_.size());
+    writer.WriteArray(statuses_.data(), statuses_.size());
+    writer.WriteArray(word_counts_.data(), word_counts_.size());
+    writer.WriteArray(live.data(), live.size());
+
+    // Terms of each live document, gathered from the postings in two passes
+    vector<uint64_t> offsets(external_ids_.size() + 1, 0);
+    for (int term_id = 0; term_id < terms_.size(); ++term_id) {
+        term_postings_[term_id].ForEach([&](int id, uint32_t) {
+            if (!tombstones_[id]) {
+                ++offsets[id + 1];
+            }
+        });
+    }
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    vector<int> term_ids(offsets.back());
+    vector<uint32_t> counts(offsets.back());
+    vector<uint64_t> positions(offsets.begin(), offsets.end() - 1);
+    for (int term_id = 0; term_id < terms_.size(); ++term_id) {
+        term_postings_[term_id].ForEach([&](int id, uint32_t count) {
+            if (!tombstones_[id]) {
+                term_ids[positions[id]] = term_id;
+                counts[positions[id]++] = count;
+            }
+        });
+    }
+    writer.WriteArray(offsets.data(), offsets.size());
+    writer.WriteArray(term_ids.data(), term_ids.size());
+    writer.WriteArray(counts.data(), counts.size());
+    writer.Close();
+}
+
+SearchServer SearchServer::LoadIndex(const string& path) {
+    auto file = make_shared<const MappedFile>(path);
+    IndexFileReader reader(file);
+    SearchServer server(reader.ReadStrings());
+    server.mapped_file_ = move(file);
+    const int32_t stored_document_count = reader.Read<int32_t>();
+    server.terms_ = TermDictionary::Load(reader);
+    server.term_postings_.reserve(server.terms_.size());
+    for (int term_id = 0; term_id < server.terms_.size(); ++term_id) {
+        server.term_postings_.push_back(PostingList::Load(reader, stored_document_count));
+    }
+    server.term_inverse_document_freqs_.resize(server.terms_.size());
+    server.term_tombstone_counts_.resize(server.terms_.size());
+
+    const auto [external_ids, document_count] = reader.ReadArray<int>();
+    const auto [ratings, rating_count] = reader.ReadArray<int>();
+    const auto [statuses, status_count] = reader.ReadArray<DocumentStatus>();
+    const auto [word_counts, word_count_count] = reader.ReadArray<int>();
+    const auto [live, live_count] = reader.ReadArray<uint8_t>();
+    const auto [term_offsets, term_offset_count] = reader.ReadArray<uint64_t>();
+    const auto [term_ids, term_id_count] = reader.ReadArray<int>();
+    const auto [term_counts, term_count_count] = reader.ReadArray<uint32_t>();
+    if (document_count != static_cast<uint64_t>(stored_document_count)
+        || rating_count != document_count || status_count != document_count || word_count_count != document_count
+        || live_count != document_count || term_offset_count != document_count + 1
+        || term_offsets[0] != 0 || term_offsets[document_count] != term_id_count || term_count_count != term_id_count
+        || !reader.AtEnd()) {
+        throw runtime_error("Index file is corrupted"s);
+    }
+    for (uint64_t internal_id = 0; internal_id < document_count; ++internal_id) {
+        if (statuses[internal_id] < DocumentStatus::ACTUAL || statuses[internal_id] > DocumentStatus::REMOVED
+            || term_offsets[internal_id] > term_offsets[internal_id + 1]) {
+            throw runtime_error("Index file is corrupted"s);
+        }
+    }
+    server.external_ids_.assign(external_ids, external_ids + document_count);
+    server.ratings_.assign(ratings, ratings + document_count);
+    server.statuses_.assign(statuses, statuses + document_count);
+    server.word_counts_.assign(word_counts, word_counts + document_count);
+    server.tombstones_.resize(document_count);
+    server.external_to_internal_ids_.reserve(document_count);
+    vector<int> document_ids;
+    document_ids.reserve(document_count);
+    for (int internal_id = 0; internal_id < static_cast<int>(document_count); ++internal_id) {
+        server.tombstones_[internal_id] = !live[internal_id];
+        if (live[internal_id]) {
+            server.external_to_internal_ids_.emplace(external_ids[internal_id], internal_id);
+            document_ids.push_back(external_ids[internal_id]);
+        }
+    }
+    // Building the set from sorted ids takes linear time
+    sort(document_ids.begin(), document_ids.end());
+    server.document_ids_.insert(document_ids.begin(), document_ids.end());
+    server.word_frequencies_.resize(document_count);
+    server.loaded_document_terms_ = {term_offsets, term_ids, term_counts,
+                                     make_unique<once_flag[]>(document_count), static_cast<int>(document_count)};
+    return server;
+}
+
+
+int SearchServer::InsertTerm(string_view word) {
+    const int term_id = terms_.Insert(word);
+    if (term_id == static_cast<int>(term_postings_.size())) {
+        term_postings_.emplace_back();
+        term_inverse_document_freqs_.emplace_back();
+        term_tombstone_counts_.push_back(0);
+    }
+    return term_id;
+}
+
+void SearchServer::EnsureWordFrequencies(int internal_id) const {
+    const LoadedDocumentTerms& loaded = loaded_document_terms_;
+    if (internal_id >= loaded.document_count) {
+        return;
+    }
+    // Building every map would touch the terms of every document, so it is left out of loading
+    call_once(loaded.once[internal_id], [&] {
+        map<string_view, double> word_frequencies;
+        for (uint64_t i = loaded.offsets[internal_id]; i < loaded.offsets[internal_id + 1]; ++i) {
+            if (loaded.term_ids[i] < 0 || loaded.term_ids[i] >= terms_.size() || loaded.counts[i] == 0
+                || loaded.counts[i] > static_cast<uint32_t>(max(word_counts_[internal_id], 0))) {
+                throw runtime_error("Index file is corrupted"s);
+            }
+            word_frequencies.emplace(terms_.GetTerm(loaded.term_ids[i]), loaded.counts[i] * 1.0 / word_counts_[internal_id]);
+        }
+        word_frequencies_[internal_id] = move(word_frequencies);
+    });
+}
+
+int SearchServer::GetLivePostingCount(int term_id) const {
+    return term_postings_[term_id].size() - term_tombstone_counts_[term_id];
+}
+
+void SearchServer::CheckPostings(const vector<int>& term_ids) const {
+    for (const int term_id : term_ids) {
+        term_postings_[term_id].CheckBlocks();
+    }
+}
+
+void SearchServer::CheckPostings(const vector<string_view>& words) const {
+    for (const string_view word : words) {
+        const int term_id = terms_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            term_postings_[term_id].CheckBlocks();
+        }
+    }
+}
+
+int SearchServer::FindInternalId(int document_id) const {
+    const auto it = external_to_internal_ids_.find(document_id);
+    return it == external_to_internal_ids_.end() ? NO_DOCUMENT : it->second;
+}
+
+ScoreAccumulator& SearchServer::GetThreadScoreAccumulator() {
+    thread_local ScoreAccumulator accumulator;
+    return accumulator;
+}
+
+vector<SearchServer::DocumentRange> SearchServer::SplitDocumentRanges() const {
+    // Small ranges are not worth a task of their own
+    const int min_range_size = 4096;
+    const int id_count = static_cast<int>(external_ids_.size());
+    const int max_range_count = max(1u, thread::hardware_concurrency()) * 2;
+    const int range_count = clamp(id_count / min_range_size, 1, max_range_count);
+
+    vector<DocumentRange> ranges;
+    for (int i = 0; i < range_count; ++i) {
+        ranges.push_back({
+            static_cast<int>(static_cast<int64_t>(id_count) * i / range_count),
+            static_cast<int>(static_cast<int64_t>(id_count) * (i + 1) / range_count)
+        });
+    }
+    return ranges;
+}
 
 bool SearchServer::IsStopWord(const string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_word_filter_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(const string_view word) {
     // A valid word must not contain special characters
-    return none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-    });
+    return !ContainsControlChars(word);
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
-    for (const string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
+void SearchServer::SplitIntoWordsNoStop(string_view text, vector<string_view>& words) const {
+    words.clear();
+    ForEachWord(text, [&](string_view word, bool is_valid) {
+        if (!is_valid) {
             throw invalid_argument("Word "s + string(word) + " is invalid"s);
         }
         if (!IsStopWord(word)) {
             words.push_back(word);
         }
-    }
-    return words;
+    });
 }
 
 
@@ -204,8 +726,9 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
 }
 
 SearchServer::Query SearchServer::ParseQuery(string_view text, bool sort) const {
+    QueryStageTimer timer(QueryStage::PARSE);
     Query result;
-    for (const string_view word : SplitIntoWords(text)) {
+    ForEachWord(text, [&](string_view word, bool) {
         const auto query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -214,7 +737,7 @@ SearchServer::Query SearchServer::ParseQuery(string_view text, bool sort) const
                 result.plus_words.push_back(query_word.data);
             }
         }
-    }
+    });
     if (!sort) {
         for (auto* words : { &result.plus_words, &result.minus_words }) {
             std::sort(words->begin(), words->end());
@@ -225,6 +748,53 @@ SearchServer::Query SearchServer::ParseQuery(string_view text, bool sort) const
 }
 
 
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(string(word)).size());
+string SearchServer::MakeQueryCacheKey(const Query& query, DocumentStatus status, size_t max_result_count) {
+    // ParseQuery sorts and deduplicates the words. They contain neither spaces
+    // nor control characters, which leaves those free for separators
+    string key;
+    for (const string_view word : query.plus_words) {
+        key += word;
+        key += ' ';
+    }
+    key += '\n';
+    for (const string_view word : query.minus_words) {
+        key += word;
+        key += ' ';
+    }
+    key += '\n';
+    key += to_string(static_cast<int>(status));
+    key += ' ';
+    key += to_string(max_result_count);
+    return key;
+}
+
+
+double SearchServer::ComputeWordInverseDocumentFreq(int term_id) const {
+    auto& cached = term_inverse_document_freqs_[term_id];
+    if (cached.epoch.load(memory_order_acquire) == index_epoch_) {
+        return cached.value.load(memory_order_relaxed);
+    }
+    const double value = log(GetDocumentCount() * 1.0 / GetLivePostingCount(term_id));
+    cached.value.store(value, memory_order_relaxed);
+    cached.epoch.store(index_epoch_, memory_order_release);
+    return value;
+}
+
+vector<double> SearchServer::ComputeInverseDocumentFreqs(const Query& query) const {
+    vector<double> inverse_document_freqs;
+    inverse_document_freqs.reserve(query.plus_words.size());
+    for (const string_view word : query.plus_words) {
+        const int term_id = terms_.Find(word);
+        inverse_document_freqs.push_back(term_id == TermDictionary::NO_TERM ? 0.0 : ComputeWordInverseDocumentFreq(term_id));
+    }
+    return inverse_document_freqs;
+}
+
+int SearchServer::GetWordDocumentCount(string_view word) const {
+    const int term_id = terms_.Find(word);
+    return term_id == TermDictionary::NO_TERM ? 0 : GetLivePostingCount(term_id);
+}
+
+void SearchServer::BumpIndexEpoch() {
+    ++index_epoch_;
 }
@@ -8,15 +8,30 @@
 #include <numeric>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <stdexcept>
 #include <execution>
 #include <thread>
 #include <iterator>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #include "string_processing.h"
 #include "document.h"
 #include "paginator.h"
-#include "concurrent_map.h"
+#include "term_dictionary.h"
+#include "posting_list.h"
+#include "top_documents_collector.h"
+#include "score_accumulator.h"
+#include "index_file.h"
+#include "match_results.h"
+#include "stop_word_filter.h"
+#include "query_result_cache.h"
+#include "query_results.h"
+#include "query_stats.h"
+#include "search_control.h"
 
 
 
@@ -24,7 +39,16 @@ using namespace std::string_literals;
 
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double relevance_deviation = 1e-6;
+
+
+// Retrieval algorithm behind the sequential FindTopDocuments
+enum class QueryEngine {
+    // Scores every posting of every plus word; the reference implementation
+    EXHAUSTIVE,
+    // Document-at-a-time traversal that skips documents and whole posting
+    // blocks whose score bound cannot reach the current top results
+    BLOCK_MAX_WAND,
+};
 
 
 class SearchServer {
@@ -39,29 +63,83 @@ public:
 
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Same as calling AddDocument for each document in order, but tokenizes in parallel
+    // and adds either all of them or, throwing what that first failing call would, none
+    void AddDocuments(const std::vector<NewDocument>& documents);
 
 
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+    // Polls control while scoring and stops once it says so; control.GetStatus()
+    // then tells why. A stopped search returns the best of the documents whose
+    // scores it finished, which are exact but need not be the overall top ones.
+    // Block-max WAND finishes documents one by one, the exhaustive engine only
+    // once it has read every posting, so stopped before that it returns none
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                           size_t max_result_count, SearchControl& control) const;
 
 
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
     template <typename ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query, DocumentStatus status,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, std::string_view raw_query) const;
 
 
+    // Answers every query as FindTopDocuments would. Queries are run in groups
+    // of similar ones, and every group walks each posting list its queries
+    // share only once. Groups are processed in parallel
+    template <typename DocumentPredicate>
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+                                                             DocumentPredicate document_predicate,
+                                                             size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+                                                             DocumentStatus status = DocumentStatus::ACTUAL,
+                                                             size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    // Same results in one contiguous array; each is written once, at its final position
+    template <typename DocumentPredicate>
+    QueryResults FindTopDocumentsBatchFlat(const std::vector<std::string>& raw_queries,
+                                           DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    QueryResults FindTopDocumentsBatchFlat(const std::vector<std::string>& raw_queries,
+                                           DocumentStatus status = DocumentStatus::ACTUAL,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+
     int GetDocumentCount() const;
+    // False for removed documents
+    bool HasDocument(int document_id) const;
+
+    void SetQueryEngine(QueryEngine engine);
+    QueryEngine GetQueryEngine() const;
+
+    // Caches the results of the sequential FindTopDocuments calls that filter
+    // by status. Must not be called concurrently with searches
+    void EnableQueryCache(size_t capacity);
+    void DisableQueryCache();
+    // All zero while the cache is disabled
+    QueryCacheStats GetQueryCacheStats() const;
 
     const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
+    // Only marks the document as removed; its postings stay until Compact
     void RemoveDocument(int document_id);
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
+    // Removes the documents and compacts the index once for all of them. Unknown ids are ignored
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Purges the postings and forward index entries of removed documents
+    void Compact();
+    template <typename ExecutionPolicy>
+    void Compact(ExecutionPolicy&& policy);
 
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
@@ -69,20 +147,118 @@ public:
                                                                             std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&,
                                                                             std::string_view raw_query, int document_id) const;
+    // Same as MatchDocument for each of the documents, but parses the query once
+    // and matches the documents in parallel, each chunk of them in one pass over
+    // the posting lists. Throws before matching if a document is unknown
+    void MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids, MatchResults& results) const;
+    // All documents in ascending id order
+    void MatchDocuments(std::string_view raw_query, MatchResults& results) const;
+
+
+    // Writes stop words, terms, postings, document columns and the terms of
+    // every document to a binary file
+    void SaveIndex(const std::string& path) const;
+    // Maps a file written by SaveIndex. Terms and postings are used straight
+    // from the mapping, so only the document columns are copied. Throws
+    // std::runtime_error for an invalid file; a posting block or the terms of a
+    // document are only checked once first used, and throw the same way then
+    static SearchServer LoadIndex(const std::string& path);
 
 
 private:
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> id_word_frequencies_;
-    std::map<int, DocumentData> documents_;
+    // Answers IsStopWord; stop_words_ is kept for copying the configuration
+    const StopWordFilter stop_word_filter_;
+    // Set for a loaded index, whose terms and postings point into the file
+    std::shared_ptr<const MappedFile> mapped_file_;
+    TermDictionary terms_;
+    // Indexed by term id; postings hold internal document ids
+    std::vector<PostingList> term_postings_;
+    // Indexed by term id. Refreshed lazily once index_epoch_ moves on; concurrent
+    // queries may race to refresh an entry, but they all store the same value
+    struct CachedInverseDocumentFreq {
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<double> value{0.0};
+    };
+    mutable std::deque<CachedInverseDocumentFreq> term_inverse_document_freqs_;
+    // Bumped whenever the document count changes
+    uint64_t index_epoch_ = 1;
+    // Internal ids are dense and handed out in insertion order, so posting
+    // lists only ever grow at their end. Ids of removed documents are not reused
+    std::unordered_map<int, int> external_to_internal_ids_;
+    // Document columns indexed by internal id
+    std::vector<int> external_ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    std::vector<int> word_counts_;
+    // A loaded index fills each map on first use, see EnsureWordFrequencies
+    mutable std::vector<std::map<std::string_view, double>> word_frequencies_;
+    // Sorted term ids and counts of each loaded document, borrowed from the file
+    struct LoadedDocumentTerms {
+        const uint64_t* offsets = nullptr;
+        const int* term_ids = nullptr;
+        const uint32_t* counts = nullptr;
+        // Indexed by internal id
+        std::unique_ptr<std::once_flag[]> once;
+        int document_count = 0;
+    };
+    LoadedDocumentTerms loaded_document_terms_;
     std::set<int> document_ids_;
+    // Indexed by internal id. Queries skip removed documents whose postings have not been purged yet
+    std::vector<bool> tombstones_;
+    // Indexed by term id: postings of removed documents still in the list
+    std::vector<int> term_tombstone_counts_;
+    // Removed since the last compaction
+    std::vector<int> pending_removed_ids_;
+    QueryEngine query_engine_ = QueryEngine::EXHAUSTIVE;
+    // Entries are tagged with index_epoch_, so any change to the index invalidates them
+    std::unique_ptr<QueryResultCache> query_cache_;
+
+    static constexpr int NO_DOCUMENT = -1;
+    int FindInternalId(int document_id) const;
+    // Interns the word and makes room for its postings
+    int InsertTerm(std::string_view word);
+    // Throws std::runtime_error if the stored terms of a loaded document are invalid
+    void EnsureWordFrequencies(int internal_id) const;
+    // Number of documents with the term, not counting removed ones
+    int GetLivePostingCount(int term_id) const;
+    // Checks the posting lists of a loaded index ahead of parallel code
+    void CheckPostings(const std::vector<int>& term_ids) const;
+    // Same for the known words
+    void CheckPostings(const std::vector<std::string_view>& words) const;
+
+    // Adds every document of other except the skipped ones in a single pass over
+    // its posting lists. Throws before any change if an id is already present
+    void AppendDocuments(const SearchServer& other, const std::set<int>& skipped_ids);
+
+    // Reused between queries on the same thread
+    static ScoreAccumulator& GetThreadScoreAccumulator();
+    // Queries in one FindTopDocumentsBatch group
+    static constexpr size_t BATCH_GROUP_SIZE = 64;
+    // Internal document ids a FindTopDocumentsBatch group scores at once
+    static constexpr int BATCH_WINDOW_SIZE = 1024;
+    // Documents in one MatchDocuments chunk
+    static constexpr size_t MATCH_CHUNK_SIZE = 4096;
+    // Core of FindTopDocumentsBatch. Calls store_results(query_index, collector)
+    // once per query, concurrently for queries of different groups
+    template <typename DocumentPredicate, typename ResultStorer>
+    void RunQueryBatch(const std::vector<std::string>& raw_queries, DocumentPredicate document_predicate,
+                       size_t max_result_count, ResultStorer store_results) const;
+
+    // Half-open range of internal document ids
+    struct DocumentRange {
+        int first_id;
+        int last_id;
+    };
+    // Splits the internal id space into ranges for parallel scoring
+    std::vector<DocumentRange> SplitDocumentRanges() const;
 
     bool IsStopWord(const std::string_view word) const;
 
     static bool IsValidWord(const std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+    // Fills words, which may be a reused buffer
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -100,84 +276,126 @@ private:
     };
 
     Query ParseQuery(std::string_view text, bool sort = false) const;
+    // Same for queries that differ only in word order or repeated words
+    static std::string MakeQueryCacheKey(const Query& query, DocumentStatus status, size_t max_result_count);
 
     // Existence required
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    double ComputeWordInverseDocumentFreq(int term_id) const;
+    void BumpIndexEpoch();
+    // IDF of every plus word in Query::plus_words order, zero for unknown words
+    std::vector<double> ComputeInverseDocumentFreqs(const Query& query) const;
+    // Number of documents containing the word
+    int GetWordDocumentCount(std::string_view word) const;
+
 
+    // The scoring functions take plus word IDFs from the caller, so that an
+    // index holding only part of a corpus can rank by corpus-wide statistics
 
+    // Body of the sequential FindTopDocuments, shared by its cached and uncached paths
+    template <typename DocumentPredicate>
+    std::vector<Document> FindParsedTopDocuments(const Query& query, DocumentPredicate document_predicate,
+                                                 size_t max_result_count) const;
+    // Runs the configured query engine
+    template <typename DocumentPredicate>
+    void CollectTopDocuments(const Query& query, const std::vector<double>& inverse_document_freqs,
+                             DocumentPredicate document_predicate, TopDocumentsCollector& collector,
+                             SearchControl* control = nullptr) const;
+    // Scores every matching document and feeds it to the collector. A control
+    // stopping it before every posting is read leaves the collector untouched
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    void FindAllDocuments(const Query& query, const std::vector<double>& inverse_document_freqs,
+                          DocumentPredicate document_predicate, TopDocumentsCollector& collector,
+                          SearchControl* control = nullptr) const;
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate) const;
+    void FindAllDocuments(ExecutionPolicy&& policy, const Query& query, const std::vector<double>& inverse_document_freqs,
+                          DocumentPredicate document_predicate, TopDocumentsCollector& collector) const;
+    // Feeds the collector exactly the documents FindAllDocuments would let into it.
+    // Documents are visited in id order, and a control stops the visit early
+    template <typename DocumentPredicate>
+    void FindAllDocumentsBlockMaxWand(const Query& query, const std::vector<double>& inverse_document_freqs,
+                                      DocumentPredicate document_predicate, TopDocumentsCollector& collector,
+                                      SearchControl* control = nullptr) const;
+
+    friend class ShardedSearchServer;
+    friend class SegmentedSearchServer;
 };
 
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
     : stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
+    , stop_word_filter_(stop_words_)
 {
     if (!std::all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw std::invalid_argument("Some of stop words are invalid"s);
     }
 }
 
-//-----------------------------------------FindTopDocuments--------------------------------------------//
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const auto query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(query, document_predicate);
-
-    std::sort(matched_documents.begin(), matched_documents.end(),
-              [](const Document& lhs, const Document& rhs) {
-
-        if (std::abs(lhs.relevance - rhs.relevance) < relevance_deviation) {
-            return lhs.rating > rhs.rating;
-
-        } else {
-            return lhs.relevance > rhs.relevance;
+template <typename ExecutionPolicy>
+void SearchServer::Compact(ExecutionPolicy&& policy) {
+    if (pending_removed_ids_.empty()) {
+        return;
+    }
+    std::vector<int> term_ids;
+    for (int term_id = 0; term_id < terms_.size(); ++term_id) {
+        if (term_tombstone_counts_[term_id] > 0) {
+            term_ids.push_back(term_id);
         }
+    }
+    CheckPostings(term_ids);
+    std::for_each(policy, term_ids.begin(), term_ids.end(), [this](int term_id) {
+        PostingList compacted;
+        term_postings_[term_id].ForEach([&](int id, uint32_t count) {
+            if (!tombstones_[id]) {
+                compacted.Add(id, count, count * 1.0 / word_counts_[id]);
+            }
+        });
+        term_postings_[term_id] = std::move(compacted);
+        term_tombstone_counts_[term_id] = 0;
     });
-
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    for (const int internal_id : pending_removed_ids_) {
+        word_frequencies_[internal_id].clear();
     }
+    pending_removed_ids_.clear();
+}
+
+//-----------------------------------------FindTopDocuments--------------------------------------------//
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                                     size_t max_result_count) const {
+    return FindParsedTopDocuments(ParseQuery(raw_query), document_predicate, max_result_count);
+}
 
-    return matched_documents;
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindParsedTopDocuments(const Query& query, DocumentPredicate document_predicate,
+                                                           size_t max_result_count) const {
+    TopDocumentsCollector collector(max_result_count);
+    CollectTopDocuments(query, ComputeInverseDocumentFreqs(query), document_predicate, collector);
+    QueryStageTimer timer(QueryStage::MATERIALIZE);
+    return collector.Release();
 }
 
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
                                                      std::string_view raw_query,
-                                                     DocumentPredicate document_predicate) const {
+                                                     DocumentPredicate document_predicate,
+                                                     size_t max_result_count) const {
     const auto query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-
-    std::sort(std::execution::par,
-              matched_documents.begin(), matched_documents.end(),
-              [](const Document& lhs, const Document& rhs) {
-
-        if (std::abs(lhs.relevance - rhs.relevance) < relevance_deviation) {
-            return lhs.rating > rhs.rating;
-
-        } else {
-            return lhs.relevance > rhs.relevance;
-        }
-    });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-
-    return matched_documents;
+    TopDocumentsCollector collector(max_result_count);
+    FindAllDocuments(policy, query, ComputeInverseDocumentFreqs(query), document_predicate, collector);
+    QueryStageTimer timer(QueryStage::MATERIALIZE);
+    return collector.Release();
 }
 
 
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
                                                      std::string_view raw_query,
-                                                     DocumentStatus status) const {
+                                                     DocumentStatus status,
+                                                     size_t max_result_count) const {
     return FindTopDocuments(policy, raw_query, [status](int id, DocumentStatus document_status, int rating) {
         return document_status == status;
-    });
+    }, max_result_count);
 }
 
 template <typename ExecutionPolicy>
@@ -186,76 +404,517 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, s
 }
 
 
-//-----------------------------------------FindAllDocuments--------------------------------------------//
+template <typename DocumentPredicate>
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+                                                                       DocumentPredicate document_predicate,
+                                                                       size_t max_result_count) const {
+    std::vector<std::vector<Document>> results(raw_queries.size());
+    RunQueryBatch(raw_queries, document_predicate, max_result_count,
+                  [&results](size_t query_index, TopDocumentsCollector& collector) {
+        results[query_index] = collector.Release();
+    });
+    return results;
+}
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
-                                                     DocumentPredicate document_predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(std::string(word)) == 0) {
-            continue;
+QueryResults SearchServer::FindTopDocumentsBatchFlat(const std::vector<std::string>& raw_queries,
+                                                     DocumentPredicate document_predicate,
+                                                     size_t max_result_count) const {
+    // No query can return more than every document
+    max_result_count = std::min(max_result_count, static_cast<size_t>(GetDocumentCount()));
+    // Results are only written once their offsets are known
+    std::vector<TopDocumentsCollector> collectors(raw_queries.size(), TopDocumentsCollector(0));
+    RunQueryBatch(raw_queries, document_predicate, max_result_count,
+                  [&collectors](size_t query_index, TopDocumentsCollector& collector) {
+        collectors[query_index] = std::move(collector);
+    });
+    std::vector<size_t> counts(collectors.size());
+    for (size_t i = 0; i < collectors.size(); ++i) {
+        counts[i] = collectors[i].GetCount();
+    }
+    QueryResults results(counts);
+    std::vector<size_t> indexes(collectors.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+        collectors[i].ReleaseInto(results.GetSlots(i));
+    });
+    return results;
+}
+
+template <typename DocumentPredicate, typename ResultStorer>
+void SearchServer::RunQueryBatch(const std::vector<std::string>& raw_queries, DocumentPredicate document_predicate,
+                                 size_t max_result_count, ResultStorer store_results) const {
+    // Parsed up front, so that an invalid query throws before any work is done
+    std::vector<Query> queries;
+    queries.reserve(raw_queries.size());
+    for (const std::string& raw_query : raw_queries) {
+        queries.push_back(ParseQuery(raw_query));
+        CheckPostings(queries.back().plus_words);
+        CheckPostings(queries.back().minus_words);
+    }
+    // Neighbours in this order tend to share words
+    std::vector<size_t> order(queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&queries](size_t lhs, size_t rhs) {
+        return queries[lhs].plus_words < queries[rhs].plus_words;
+    });
+    std::vector<size_t> group_starts;
+    for (size_t start = 0; start < order.size(); start += BATCH_GROUP_SIZE) {
+        group_starts.push_back(start);
+    }
+
+    std::for_each(std::execution::par, group_starts.begin(), group_starts.end(), [&](size_t group_start) {
+        const size_t group_end = std::min(group_start + BATCH_GROUP_SIZE, order.size());
+        const size_t group_size = group_end - group_start;
+        // Every posting list the group needs is decoded once, one window of
+        // document ids at a time, and each of its postings goes to the window
+        // accumulators of all the queries with the term. Plus words of a query
+        // are sorted, so walking the terms in word order sums every score in the
+        // order FindAllDocuments does
+        struct Subscriber {
+            size_t query;
+            double inverse_document_freq;
+        };
+        std::map<std::string_view, std::vector<Subscriber>> plus_subscribers;
+        std::map<std::string_view, std::vector<size_t>> minus_subscribers;
+        for (size_t i = 0; i < group_size; ++i) {
+            const Query& query = queries[order[group_start + i]];
+            const std::vector<double> inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+            for (size_t j = 0; j < query.plus_words.size(); ++j) {
+                plus_subscribers[query.plus_words[j]].push_back({i, inverse_document_freqs[j]});
+            }
+            for (const std::string_view word : query.minus_words) {
+                minus_subscribers[word].push_back(i);
+            }
         }
-        
-        for (const auto [id, freq] : word_to_document_freqs_.at(std::string(word))) {
-            const auto& document_data = documents_.at(id);
-            
-            if (document_predicate(id, document_data.status, document_data.rating)) {
-                document_to_relevance[id] += freq * ComputeWordInverseDocumentFreq(std::string(word));
+        std::deque<PostingList::Cursor> plus_cursors;
+        std::vector<const std::vector<Subscriber>*> plus_cursor_subscribers;
+        for (const auto& [word, subscribers] : plus_subscribers) {
+            const int term_id = terms_.Find(word);
+            if (term_id != TermDictionary::NO_TERM) {
+                plus_cursors.emplace_back(term_postings_[term_id]);
+                plus_cursor_subscribers.push_back(&subscribers);
+            }
+        }
+        std::deque<PostingList::Cursor> minus_cursors;
+        std::vector<const std::vector<size_t>*> minus_cursor_subscribers;
+        for (const auto& [word, subscribers] : minus_subscribers) {
+            const int term_id = terms_.Find(word);
+            if (term_id != TermDictionary::NO_TERM) {
+                minus_cursors.emplace_back(term_postings_[term_id]);
+                minus_cursor_subscribers.push_back(&subscribers);
             }
         }
-    }
 
-    for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(std::string(word)) == 0) {
-            continue;
+        // Row of BATCH_WINDOW_SIZE entries per query, reused between groups on the same thread
+        enum : uint8_t { UNSCORED, SCORED, EXCLUDED };
+        thread_local std::vector<double> scores;
+        thread_local std::vector<uint8_t> states;
+        scores.resize(group_size * BATCH_WINDOW_SIZE);
+        states.assign(group_size * BATCH_WINDOW_SIZE, UNSCORED);
+        std::vector<char> touched(group_size, 0);
+        std::vector<TopDocumentsCollector> collectors(group_size, TopDocumentsCollector(max_result_count));
+        QueryStageStopwatch minus_filter(QueryStage::MINUS_FILTER);
+        QueryStageStopwatch posting_traversal(QueryStage::POSTING_TRAVERSAL);
+        QueryStageStopwatch top_k(QueryStage::TOP_K);
+        uint64_t postings_scanned = 0;
+        uint64_t documents_filtered = 0;
+        uint64_t documents_scored = 0;
+        const int document_count = static_cast<int>(external_ids_.size());
+        for (int window_start = 0; window_start < document_count; window_start += BATCH_WINDOW_SIZE) {
+            const int window_end = std::min(window_start + BATCH_WINDOW_SIZE, document_count);
+            minus_filter.Resume();
+            for (size_t k = 0; k < minus_cursors.size(); ++k) {
+                PostingList::Cursor& cursor = minus_cursors[k];
+                for (; cursor.GetDocumentId() < window_end; cursor.Next()) {
+                    const int offset = cursor.GetDocumentId() - window_start;
+                    for (const size_t query : *minus_cursor_subscribers[k]) {
+                        states[query * BATCH_WINDOW_SIZE + offset] = EXCLUDED;
+                        touched[query] = 1;
+                    }
+                    ++postings_scanned;
+                }
+            }
+            minus_filter.Pause();
+
+            posting_traversal.Resume();
+            for (size_t k = 0; k < plus_cursors.size(); ++k) {
+                PostingList::Cursor& cursor = plus_cursors[k];
+                for (; cursor.GetDocumentId() < window_end; cursor.Next()) {
+                    const int id = cursor.GetDocumentId();
+                    ++postings_scanned;
+                    if (tombstones_[id] || !document_predicate(external_ids_[id], statuses_[id], ratings_[id])) {
+                        ++documents_filtered;
+                        continue;
+                    }
+                    const double freq = cursor.GetCount() * 1.0 / word_counts_[id];
+                    for (const Subscriber& subscriber : *plus_cursor_subscribers[k]) {
+                        const size_t slot = subscriber.query * BATCH_WINDOW_SIZE + (id - window_start);
+                        if (states[slot] == UNSCORED) {
+                            states[slot] = SCORED;
+                            scores[slot] = freq * subscriber.inverse_document_freq;
+                            touched[subscriber.query] = 1;
+                        } else if (states[slot] == SCORED) {
+                            scores[slot] += freq * subscriber.inverse_document_freq;
+                        }
+                    }
+                }
+            }
+            posting_traversal.Pause();
+
+            top_k.Resume();
+            for (size_t i = 0; i < group_size; ++i) {
+                if (!touched[i]) {
+                    continue;
+                }
+                const size_t row = i * BATCH_WINDOW_SIZE;
+                for (int offset = 0; offset < window_end - window_start; ++offset) {
+                    if (states[row + offset] == SCORED) {
+                        const int id = window_start + offset;
+                        collectors[i].Add({external_ids_[id], scores[row + offset], ratings_[id]});
+                        ++documents_scored;
+                    }
+                }
+                std::fill(states.begin() + row, states.begin() + row + BATCH_WINDOW_SIZE, UNSCORED);
+                touched[i] = 0;
+            }
+            top_k.Pause();
         }
-        for (const auto [id, _] : word_to_document_freqs_.at(std::string(word))) {
-            document_to_relevance.erase(id);
+        AddQueryCounter(QueryCounter::POSTINGS_SCANNED, postings_scanned);
+        AddQueryCounter(QueryCounter::DOCUMENTS_FILTERED, documents_filtered);
+        AddQueryCounter(QueryCounter::DOCUMENTS_SCORED, documents_scored);
+        QueryStageTimer timer(QueryStage::MATERIALIZE);
+        for (size_t i = 0; i < group_size; ++i) {
+            store_results(order[group_start + i], collectors[i]);
         }
+    });
+}
+
+
+//-----------------------------------------FindAllDocuments--------------------------------------------//
+
+template <typename DocumentPredicate>
+void SearchServer::CollectTopDocuments(const Query& query,
+                                       const std::vector<double>& inverse_document_freqs,
+                                       DocumentPredicate document_predicate,
+                                       TopDocumentsCollector& collector,
+                                       SearchControl* control) const {
+    if (query_engine_ == QueryEngine::BLOCK_MAX_WAND) {
+        FindAllDocumentsBlockMaxWand(query, inverse_document_freqs, document_predicate, collector, control);
+    } else {
+        FindAllDocuments(query, inverse_document_freqs, document_predicate, collector, control);
     }
+}
 
 
-    std::vector<Document> matched_documents;
-    for (const auto [id, relevance] : document_to_relevance) {
-        matched_documents.push_back({id, relevance, documents_.at(id).rating});
+template <typename DocumentPredicate>
+void SearchServer::FindAllDocuments(const Query& query,
+                                    const std::vector<double>& inverse_document_freqs,
+                                    DocumentPredicate document_predicate,
+                                    TopDocumentsCollector& collector,
+                                    SearchControl* control) const {
+    ScoreAccumulator& document_to_relevance = GetThreadScoreAccumulator();
+    document_to_relevance.Clear();
+    uint64_t postings_scanned = 0;
+    uint64_t documents_filtered = 0;
+    uint64_t documents_scored = 0;
+    // Posting lists cannot be left halfway, so the rest of them is skipped
+    bool stopped = false;
+    const auto should_stop = [&stopped, control] {
+        return control != nullptr && (stopped || (stopped = control->ShouldStop()));
+    };
+
+    {
+        QueryStageTimer timer(QueryStage::MINUS_FILTER);
+        for (const std::string_view& word : query.minus_words) {
+            const int term_id = terms_.Find(word);
+            if (term_id == TermDictionary::NO_TERM) {
+                continue;
+            }
+            postings_scanned += term_postings_[term_id].size();
+            term_postings_[term_id].ForEach([&](int id, uint32_t) {
+                if (!should_stop()) {
+                    document_to_relevance.Exclude(id);
+                }
+            });
+        }
     }
 
-    return matched_documents;
+    {
+        QueryStageTimer timer(QueryStage::POSTING_TRAVERSAL);
+        for (size_t i = 0; i < query.plus_words.size(); ++i) {
+            const int term_id = terms_.Find(query.plus_words[i]);
+            if (term_id == TermDictionary::NO_TERM) {
+                continue;
+            }
+            const double inverse_document_freq = inverse_document_freqs[i];
+
+            postings_scanned += term_postings_[term_id].size();
+            term_postings_[term_id].ForEach([&](int id, uint32_t count) {
+                if (should_stop()) {
+                    return;
+                }
+                if (!tombstones_[id] && document_predicate(external_ids_[id], statuses_[id], ratings_[id])) {
+                    const double freq = count * 1.0 / word_counts_[id];
+                    document_to_relevance.Add(id, freq * inverse_document_freq);
+                } else {
+                    ++documents_filtered;
+                }
+            });
+        }
+    }
+
+    // Scores are only exact once every posting has been read
+    if (!stopped) {
+        QueryStageTimer timer(QueryStage::TOP_K);
+        document_to_relevance.ForEach([&](int id, double relevance) {
+            if (!should_stop()) {
+                collector.Add({external_ids_[id], relevance, ratings_[id]});
+                ++documents_scored;
+            }
+        });
+    }
+    AddQueryCounter(QueryCounter::POSTINGS_SCANNED, postings_scanned);
+    AddQueryCounter(QueryCounter::DOCUMENTS_FILTERED, documents_filtered);
+    AddQueryCounter(QueryCounter::DOCUMENTS_SCORED, documents_scored);
 }
 
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy,
-                                                     const Query& query,
-                                                     DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(query.plus_words.size());
+void SearchServer::FindAllDocuments(ExecutionPolicy&& policy,
+                                    const Query& query,
+                                    const std::vector<double>& query_inverse_document_freqs,
+                                    DocumentPredicate document_predicate,
+                                    TopDocumentsCollector& collector) const {
+    std::vector<int> plus_term_ids;
+    std::vector<double> inverse_document_freqs;
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const int term_id = terms_.Find(query.plus_words[i]);
+        if (term_id != TermDictionary::NO_TERM) {
+            plus_term_ids.push_back(term_id);
+            inverse_document_freqs.push_back(query_inverse_document_freqs[i]);
+        }
+    }
+    std::vector<int> minus_term_ids;
+    for (const std::string_view word : query.minus_words) {
+        const int term_id = terms_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            minus_term_ids.push_back(term_id);
+        }
+    }
+    CheckPostings(plus_term_ids);
+    CheckPostings(minus_term_ids);
+
+    // Every partition owns a range of internal ids and scores all the words for
+    // it, so no two threads ever touch the same accumulator or collector
+    std::vector<DocumentRange> ranges = SplitDocumentRanges();
+    std::vector<TopDocumentsCollector> partial_collectors(ranges.size(), TopDocumentsCollector(collector.GetMaxCount()));
+    std::vector<size_t> indexes(ranges.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+
+    std::for_each(policy, indexes.begin(), indexes.end(), [&](size_t index) {
+        const auto [first_id, last_id] = ranges[index];
+        ScoreAccumulator& document_to_relevance = GetThreadScoreAccumulator();
+        document_to_relevance.Clear();
+        uint64_t postings_scanned = 0;
+        uint64_t documents_filtered = 0;
+        uint64_t documents_scored = 0;
+
+        {
+            QueryStageTimer timer(QueryStage::MINUS_FILTER);
+            for (const int term_id : minus_term_ids) {
+                term_postings_[term_id].ForEachInRange(first_id, last_id, [&](int id, uint32_t) {
+                    document_to_relevance.Exclude(id);
+                    ++postings_scanned;
+                });
+            }
+        }
+        {
+            QueryStageTimer timer(QueryStage::POSTING_TRAVERSAL);
+            for (size_t i = 0; i < plus_term_ids.size(); ++i) {
+                const double inverse_document_freq = inverse_document_freqs[i];
+                term_postings_[plus_term_ids[i]].ForEachInRange(first_id, last_id, [&](int id, uint32_t count) {
+                    ++postings_scanned;
+                    if (!tombstones_[id] && document_predicate(external_ids_[id], statuses_[id], ratings_[id])) {
+                        const double freq = count * 1.0 / word_counts_[id];
+                        document_to_relevance.Add(id, freq * inverse_document_freq);
+                    } else {
+                        ++documents_filtered;
+                    }
+                });
+            }
+        }
+        {
+            QueryStageTimer timer(QueryStage::TOP_K);
+            document_to_relevance.ForEach([&](int id, double relevance) {
+                partial_collectors[index].Add({ external_ids_[id], relevance, ratings_[id] });
+                ++documents_scored;
+            });
+        }
+        AddQueryCounter(QueryCounter::POSTINGS_SCANNED, postings_scanned);
+        AddQueryCounter(QueryCounter::DOCUMENTS_FILTERED, documents_filtered);
+        AddQueryCounter(QueryCounter::DOCUMENTS_SCORED, documents_scored);
+    });
 
-    std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](std::string_view word) {
-        if (word_to_document_freqs_.count(std::string(word)) > 0) {
+    QueryStageTimer timer(QueryStage::TOP_K);
+    for (TopDocumentsCollector& partial_collector : partial_collectors) {
+        collector.Merge(std::move(partial_collector));
+    }
+}
 
-            for (const auto [id, freq] : word_to_document_freqs_.at(std::string(word))) {
-                const auto& document_data = documents_.at(id);
 
-                if (document_predicate(id, document_data.status, document_data.rating)) {
-                    document_to_relevance[id].ref_to_value += freq * ComputeWordInverseDocumentFreq(std::string(word));
+template <typename DocumentPredicate>
+void SearchServer::FindAllDocumentsBlockMaxWand(const Query& query,
+                                                const std::vector<double>& inverse_document_freqs,
+                                                DocumentPredicate document_predicate,
+                                                TopDocumentsCollector& collector,
+                                                SearchControl* control) const {
+    struct WandTerm {
+        PostingList::Cursor cursor;
+        double idf;
+        // Weight for score bounds; a negative idf can only lower the score
+        double bound_weight;
+        double upper_bound;
+
+        WandTerm(const PostingList& postings, double idf)
+            : cursor(postings)
+            , idf(idf)
+            , bound_weight(std::max(idf, 0.0))
+            , upper_bound(postings.GetMaxTermFreq() * bound_weight) {
+        }
+    };
+
+    if (collector.IsFull()) {
+        return;
+    }
+
+    // Kept in query order, so that scores are summed exactly as FindAllDocuments sums them
+    std::deque<WandTerm> terms;
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        const int term_id = terms_.Find(query.plus_words[i]);
+        if (term_id != TermDictionary::NO_TERM && GetLivePostingCount(term_id) > 0) {
+            terms.emplace_back(term_postings_[term_id], inverse_document_freqs[i]);
+        }
+    }
+    std::deque<PostingList::Cursor> minus_cursors;
+    for (const std::string_view word : query.minus_words) {
+        const int term_id = terms_.Find(word);
+        if (term_id != TermDictionary::NO_TERM) {
+            minus_cursors.emplace_back(term_postings_[term_id]);
+        }
+    }
+
+    QueryStageTimer timer(QueryStage::POSTING_TRAVERSAL);
+    uint64_t postings_scanned = 0;
+    uint64_t documents_filtered = 0;
+    uint64_t documents_scored = 0;
+
+    std::vector<WandTerm*> order;
+    for (WandTerm& term : terms) {
+        order.push_back(&term);
+    }
+    const auto by_document_id = [](const WandTerm* lhs, const WandTerm* rhs) {
+        return lhs->cursor.GetDocumentId() < rhs->cursor.GetDocumentId();
+    };
+    std::sort(order.begin(), order.end(), by_document_id);
+    // Cursors only move forward, and every step moves a prefix of order, so
+    // inserting those back into the sorted rest keeps order sorted
+    const auto restore_order = [&order, &by_document_id](size_t moved_count) {
+        for (size_t i = moved_count; i-- > 0;) {
+            for (size_t j = i; j + 1 < order.size() && by_document_id(order[j + 1], order[j]); ++j) {
+                std::swap(order[j], order[j + 1]);
+            }
+        }
+    };
+    // The collector takes a document only if IsMoreRelevant prefers it to the
+    // current worst one; the doubled tolerance absorbs rounding in the bounds
+    const auto can_enter = [&collector](double upper_bound) {
+        return !collector.IsFull() || upper_bound >= collector.GetWorst().relevance - 2 * relevance_deviation;
+    };
+
+    while (true) {
+        if (control != nullptr && control->ShouldStop()) {
+            break;
+        }
+
+        // Pivot: the first document that the terms up to it could push into the collector
+        double upper_bound = 0.0;
+        size_t pivot = 0;
+        while (pivot < order.size()) {
+            upper_bound += order[pivot]->upper_bound;
+            if (can_enter(upper_bound)) {
+                break;
+            }
+            ++pivot;
+        }
+        if (pivot == order.size()) {
+            break;
+        }
+        const int pivot_id = order[pivot]->cursor.GetDocumentId();
+        if (pivot_id == PostingList::Cursor::END) {
+            break;
+        }
+        while (pivot + 1 < order.size() && order[pivot + 1]->cursor.GetDocumentId() == pivot_id) {
+            ++pivot;
+        }
+
+        double block_upper_bound = 0.0;
+        for (size_t i = 0; i <= pivot; ++i) {
+            block_upper_bound += order[i]->cursor.GetBlockMaxTermFreq(pivot_id) * order[i]->bound_weight;
+        }
+        if (!can_enter(block_upper_bound)) {
+            // Nothing before the end of the current blocks can enter either
+            int next_id = pivot + 1 < order.size() ? order[pivot + 1]->cursor.GetDocumentId() : PostingList::Cursor::END;
+            for (size_t i = 0; i <= pivot; ++i) {
+                const int block_last_id = order[i]->cursor.GetBlockLastDocumentId(pivot_id);
+                if (block_last_id != PostingList::Cursor::END) {
+                    next_id = std::min(next_id, block_last_id + 1);
                 }
             }
+            for (size_t i = 0; i <= pivot; ++i) {
+                order[i]->cursor.NextGeq(next_id);
+            }
+            restore_order(pivot + 1);
+            continue;
         }
-    });
 
-    std::for_each(policy, query.minus_words.begin(), query.minus_words.end(), [&](std::string_view word) {
-        if (word_to_document_freqs_.count(std::string(word)) > 0) {
-            for (const auto [id, _] : word_to_document_freqs_.at(std::string(word))) {
-                document_to_relevance.BuildOrdinaryMap().erase(id);
+        if (order[0]->cursor.GetDocumentId() != pivot_id) {
+            size_t moved_count = 0;
+            for (; moved_count < pivot && order[moved_count]->cursor.GetDocumentId() < pivot_id; ++moved_count) {
+                order[moved_count]->cursor.NextGeq(pivot_id);
             }
+            restore_order(moved_count);
+            continue;
         }
-    });
 
-    std::vector<Document> matched_documents;
-    for (const auto& [id, relevance] : document_to_relevance.BuildOrdinaryMap()) {
-        matched_documents.push_back({ id, relevance, documents_.at(id).rating });
+        const bool has_minus_word = std::any_of(minus_cursors.begin(), minus_cursors.end(),
+                                                [pivot_id](PostingList::Cursor& cursor) {
+            cursor.NextGeq(pivot_id);
+            return cursor.GetDocumentId() == pivot_id;
+        });
+        postings_scanned += pivot + 1;
+        if (!has_minus_word) {
+            if (tombstones_[pivot_id] || !document_predicate(external_ids_[pivot_id], statuses_[pivot_id], ratings_[pivot_id])) {
+                // The terms up to the pivot are the postings of the document
+                documents_filtered += pivot + 1;
+            } else {
+                double relevance = 0.0;
+                for (const WandTerm& term : terms) {
+                    if (term.cursor.GetDocumentId() == pivot_id) {
+                        const double freq = term.cursor.GetCount() * 1.0 / word_counts_[pivot_id];
+                        relevance += freq * term.idf;
+                    }
+                }
+                collector.Add({external_ids_[pivot_id], relevance, ratings_[pivot_id]});
+                ++documents_scored;
+            }
+        }
+        for (size_t i = 0; i <= pivot; ++i) {
+            order[i]->cursor.Next();
+        }
+        restore_order(pivot + 1);
     }
-
-    return matched_documents;
+    AddQueryCounter(QueryCounter::POSTINGS_SCANNED, postings_scanned);
+    AddQueryCounter(QueryCounter::DOCUMENTS_FILTERED, documents_filtered);
+    AddQueryCounter(QueryCounter::DOCUMENTS_SCORED, documents_scored);
 }
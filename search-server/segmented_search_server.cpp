@@ -0,0 +1,325 @@
+#include "segmented_search_server.h"
+
+#include <cmath>
+#include <iterator>
+
+using namespace std;
+
+
+SegmentedSearchServer::SegmentRemovals::SegmentRemovals(const SearchServer& index)
+    : removal_numbers(make_shared<vector<atomic<uint64_t>>>(index.external_ids_.size()))
+    , term_removed_counts(make_shared<const vector<int>>(index.terms_.size())) {
+}
+
+bool SegmentedSearchServer::SegmentRemovals::IsRemoved(int internal_id) const {
+    const uint64_t removal_number = (*removal_numbers)[internal_id].load(memory_order_acquire);
+    return removal_number != 0 && removal_number <= last_removal;
+}
+
+int SegmentedSearchServer::SegmentRemovals::GetTermRemovedCount(int term_id) const {
+    const auto [first, last] = equal_range(recent_term_ids.begin(), recent_term_ids.end(), term_id);
+    return (*term_removed_counts)[term_id] + static_cast<int>(last - first);
+}
+
+
+bool SegmentedSearchServer::Segment::Contains(int document_id) const {
+    const int internal_id = index->FindInternalId(document_id);
+    return internal_id != SearchServer::NO_DOCUMENT && !removals->IsRemoved(internal_id);
+}
+
+int SegmentedSearchServer::Segment::GetDocumentCount() const {
+    return index->GetDocumentCount() - removals->removed_count;
+}
+
+set<int> SegmentedSearchServer::Segment::GetRemovedIds() const {
+    set<int> removed_ids;
+    for (const int document_id : *index) {
+        if (removals->IsRemoved(index->FindInternalId(document_id))) {
+            removed_ids.insert(removed_ids.end(), document_id);
+        }
+    }
+    return removed_ids;
+}
+
+SegmentedSearchServer::Segment SegmentedSearchServer::Segment::Remove(int internal_id, uint64_t removal_number) const {
+    auto new_removals = make_shared<SegmentRemovals>(*removals);
+    vector<int> term_ids;
+    for (const auto& [word, freq] : index->GetWordFrequencies(index->external_ids_[internal_id])) {
+        term_ids.push_back(index->terms_.Find(word));
+    }
+    sort(term_ids.begin(), term_ids.end());
+    if (++new_removals->recent_removal_count > MAX_RECENT_REMOVALS) {
+        // Fold the recent removals into a fresh copy of the counts
+        auto term_removed_counts = make_shared<vector<int>>(*new_removals->term_removed_counts);
+        for (const int term_id : new_removals->recent_term_ids) {
+            ++(*term_removed_counts)[term_id];
+        }
+        for (const int term_id : term_ids) {
+            ++(*term_removed_counts)[term_id];
+        }
+        new_removals->term_removed_counts = move(term_removed_counts);
+        new_removals->recent_term_ids.clear();
+        new_removals->recent_removal_count = 0;
+    } else {
+        vector<int> recent_term_ids;
+        recent_term_ids.reserve(new_removals->recent_term_ids.size() + term_ids.size());
+        merge(new_removals->recent_term_ids.begin(), new_removals->recent_term_ids.end(),
+              term_ids.begin(), term_ids.end(), back_inserter(recent_term_ids));
+        new_removals->recent_term_ids = move(recent_term_ids);
+    }
+    // Earlier generations see numbers past their last_removal as live
+    (*new_removals->removal_numbers)[internal_id].store(removal_number, memory_order_release);
+    new_removals->last_removal = removal_number;
+    ++new_removals->removed_count;
+    return {index, move(new_removals)};
+}
+
+
+SegmentedSearchServer::SegmentedSearchServer(string_view stop_words_text, size_t buffer_capacity, size_t max_segment_count,
+                                             chrono::milliseconds seal_interval)
+    : SegmentedSearchServer(SplitIntoWords(stop_words_text), buffer_capacity, max_segment_count, seal_interval) {
+}
+
+SegmentedSearchServer::SegmentedSearchServer(const string& stop_words_text, size_t buffer_capacity, size_t max_segment_count,
+                                             chrono::milliseconds seal_interval)
+    : SegmentedSearchServer(SplitIntoWords(stop_words_text), buffer_capacity, max_segment_count, seal_interval) {
+}
+
+SegmentedSearchServer::~SegmentedSearchServer() {
+    {
+        lock_guard guard(merge_mutex_);
+        stopping_ = true;
+    }
+    merge_condition_.notify_all();
+    merge_thread_.join();
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    lock_guard guard(write_mutex_);
+    const auto snapshot = GetSnapshot();
+    if (any_of(snapshot->begin(), snapshot->end(), [document_id](const Segment& segment) {
+        return segment.Contains(document_id);
+    })) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    buffer_->AddDocument(document_id, document, status, ratings);
+    if (static_cast<size_t>(buffer_->GetDocumentCount()) >= buffer_capacity_) {
+        SealBuffer();
+    }
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    lock_guard guard(write_mutex_);
+    if (buffer_->FindInternalId(document_id) != SearchServer::NO_DOCUMENT) {
+        buffer_->RemoveDocument(document_id);
+        return;
+    }
+
+    const auto snapshot = GetSnapshot();
+    for (size_t i = 0; i < snapshot->size(); ++i) {
+        const Segment& segment = (*snapshot)[i];
+        if (!segment.Contains(document_id)) {
+            continue;
+        }
+        auto new_snapshot = make_shared<Snapshot>(*snapshot);
+        (*new_snapshot)[i] = segment.Remove(segment.index->FindInternalId(document_id), ++removal_count_);
+        const bool needs_purge = NeedsPurge((*new_snapshot)[i]);
+        atomic_store(&snapshot_, shared_ptr<const Snapshot>(move(new_snapshot)));
+        if (needs_purge) {
+            RequestMerge();
+        }
+        return;
+    }
+}
+
+void SegmentedSearchServer::Flush() {
+    lock_guard guard(write_mutex_);
+    SealBuffer();
+}
+
+void SegmentedSearchServer::WaitForMerges() {
+    unique_lock lock(merge_mutex_);
+    merge_condition_.wait(lock, [this] {
+        return !merge_requested_ && !merging_;
+    });
+}
+
+vector<Document> SegmentedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t max_result_count) const {
+    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    }, max_result_count);
+}
+
+vector<Document> SegmentedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+tuple<vector<string_view>, DocumentStatus> SegmentedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    const auto snapshot = GetSnapshot();
+    for (const Segment& segment : *snapshot) {
+        if (segment.Contains(document_id)) {
+            return segment.index->MatchDocument(raw_query, document_id);
+        }
+    }
+    throw invalid_argument("Invalid document_id"s);
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    const auto snapshot = GetSnapshot();
+    int document_count = 0;
+    for (const Segment& segment : *snapshot) {
+        document_count += segment.GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+    return GetSnapshot()->size();
+}
+
+shared_ptr<const SegmentedSearchServer::Snapshot> SegmentedSearchServer::GetSnapshot() const {
+    return atomic_load(&snapshot_);
+}
+
+void SegmentedSearchServer::SealBuffer() {
+    if (buffer_->GetDocumentCount() == 0) {
+        return;
+    }
+    auto new_snapshot = make_shared<Snapshot>(*GetSnapshot());
+    auto removals = make_shared<SegmentRemovals>(*buffer_);
+    new_snapshot->push_back({shared_ptr<const SearchServer>(move(buffer_)), move(removals)});
+    const size_t segment_count = new_snapshot->size();
+    atomic_store(&snapshot_, shared_ptr<const Snapshot>(move(new_snapshot)));
+    buffer_ = make_unique<SearchServer>(stop_words_);
+    if (segment_count > max_segment_count_) {
+        RequestMerge();
+    }
+}
+
+void SegmentedSearchServer::RequestMerge() {
+    {
+        lock_guard guard(merge_mutex_);
+        merge_requested_ = true;
+    }
+    merge_condition_.notify_all();
+}
+
+void SegmentedSearchServer::RunMerges() {
+    auto next_seal = chrono::steady_clock::now() + seal_interval_;
+    unique_lock lock(merge_mutex_);
+    while (true) {
+        merge_condition_.wait_until(lock, next_seal, [this] {
+            return stopping_ || merge_requested_;
+        });
+        if (stopping_) {
+            return;
+        }
+        const bool merge_requested = merge_requested_;
+        merge_requested_ = false;
+        merging_ = merge_requested;
+        lock.unlock();
+        if (chrono::steady_clock::now() >= next_seal) {
+            {
+                lock_guard guard(write_mutex_);
+                SealBuffer();
+            }
+            next_seal = chrono::steady_clock::now() + seal_interval_;
+        }
+        if (merge_requested) {
+            while (MergeOnce()) {
+            }
+        }
+        lock.lock();
+        if (merge_requested) {
+            merging_ = false;
+            merge_condition_.notify_all();
+        }
+    }
+}
+
+bool SegmentedSearchServer::MergeOnce() {
+    const auto snapshot = GetSnapshot();
+    size_t first = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < snapshot->size() && count == 0; ++i) {
+        if (NeedsPurge((*snapshot)[i])) {
+            first = i;
+            count = 1;
+        }
+    }
+    if (count == 0 && snapshot->size() > max_segment_count_) {
+        for (size_t i = 1; i + 1 < snapshot->size(); ++i) {
+            if ((*snapshot)[i].GetDocumentCount() + (*snapshot)[i + 1].GetDocumentCount()
+                < (*snapshot)[first].GetDocumentCount() + (*snapshot)[first + 1].GetDocumentCount()) {
+                first = i;
+            }
+        }
+        count = 2;
+    }
+    if (count == 0) {
+        return false;
+    }
+
+    // Segments are immutable, so the expensive part runs without any lock.
+    // Removals are only ever added, so the ids taken here are still removed later
+    auto merged = make_shared<SearchServer>(stop_words_);
+    vector<set<int>> merged_removed_ids;
+    for (size_t i = first; i < first + count; ++i) {
+        merged_removed_ids.push_back((*snapshot)[i].GetRemovedIds());
+        merged->AppendDocuments(*(*snapshot)[i].index, merged_removed_ids.back());
+    }
+    Segment merged_segment{merged, make_shared<SegmentRemovals>(*merged)};
+
+    lock_guard guard(write_mutex_);
+    const auto current = GetSnapshot();
+    // Writers only append segments, so the merged ones are still adjacent
+    size_t position = 0;
+    while ((*current)[position].index != (*snapshot)[first].index) {
+        ++position;
+    }
+    // Carry over the documents removed while the merge was running
+    for (size_t i = 0; i < count; ++i) {
+        for (const int document_id : (*current)[position + i].GetRemovedIds()) {
+            if (merged_removed_ids[i].count(document_id) == 0) {
+                merged_segment = merged_segment.Remove(merged->FindInternalId(document_id), ++removal_count_);
+            }
+        }
+    }
+
+    auto new_snapshot = make_shared<Snapshot>();
+    new_snapshot->reserve(current->size() - count + 1);
+    new_snapshot->insert(new_snapshot->end(), current->begin(), current->begin() + position);
+    if (merged_segment.GetDocumentCount() > 0) {
+        new_snapshot->push_back(move(merged_segment));
+    }
+    new_snapshot->insert(new_snapshot->end(), current->begin() + position + count, current->end());
+    atomic_store(&snapshot_, shared_ptr<const Snapshot>(move(new_snapshot)));
+    return true;
+}
+
+bool SegmentedSearchServer::NeedsPurge(const Segment& segment) const {
+    return segment.removals->removed_count > MAX_REMOVED_SHARE * segment.index->GetDocumentCount();
+}
+
+vector<double> SegmentedSearchServer::ComputeInverseDocumentFreqs(const Snapshot& snapshot, const SearchServer::Query& query) {
+    int document_count = 0;
+    for (const Segment& segment : snapshot) {
+        document_count += segment.GetDocumentCount();
+    }
+
+    vector<double> inverse_document_freqs;
+    inverse_document_freqs.reserve(query.plus_words.size());
+    for (const string_view word : query.plus_words) {
+        int word_document_count = 0;
+        for (const Segment& segment : snapshot) {
+            const int term_id = segment.index->terms_.Find(word);
+            if (term_id != TermDictionary::NO_TERM) {
+                // Removed documents still have postings until their segment is rewritten
+                word_document_count += segment.index->GetLivePostingCount(term_id)
+                    - segment.removals->GetTermRemovedCount(term_id);
+            }
+        }
+        inverse_document_freqs.push_back(word_document_count == 0 ? 0.0 : log(document_count * 1.0 / word_document_count));
+    }
+    return inverse_document_freqs;
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <execution>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+#include "string_processing.h"
+#include "top_documents_collector.h"
+
+
+// Index that can be searched while documents are being added and removed.
+//
+// New documents go to a private buffer, which is sealed into an immutable
+// segment once it holds buffer_capacity documents, every seal_interval, or on
+// Flush(). Queries work on a snapshot of the sealed segments: a shared_ptr to an
+// immutable list, which writers replace atomically and which is freed when its
+// last reader is done.
+// Removing a document from a sealed segment publishes a snapshot with a new
+// removal generation of the segment, which shares all bulky state with the
+// previous one, so queries already running still see the document. A
+// background thread merges adjacent segments whenever there are more than
+// max_segment_count of them, and rewrites a segment once too much of it is
+// removed; both drop the removed documents.
+//
+// Any number of threads may query concurrently with one another and with writers.
+class SegmentedSearchServer {
+public:
+    static const size_t DEFAULT_BUFFER_CAPACITY = 1024;
+    static const size_t DEFAULT_MAX_SEGMENT_COUNT = 8;
+    static constexpr std::chrono::milliseconds DEFAULT_SEAL_INTERVAL{1000};
+
+    template <typename StringContainer>
+    explicit SegmentedSearchServer(const StringContainer& stop_words,
+                                   size_t buffer_capacity = DEFAULT_BUFFER_CAPACITY,
+                                   size_t max_segment_count = DEFAULT_MAX_SEGMENT_COUNT,
+                                   std::chrono::milliseconds seal_interval = DEFAULT_SEAL_INTERVAL);
+    explicit SegmentedSearchServer(std::string_view stop_words_text,
+                                   size_t buffer_capacity = DEFAULT_BUFFER_CAPACITY,
+                                   size_t max_segment_count = DEFAULT_MAX_SEGMENT_COUNT,
+                                   std::chrono::milliseconds seal_interval = DEFAULT_SEAL_INTERVAL);
+    explicit SegmentedSearchServer(const std::string& stop_words_text,
+                                   size_t buffer_capacity = DEFAULT_BUFFER_CAPACITY,
+                                   size_t max_segment_count = DEFAULT_MAX_SEGMENT_COUNT,
+                                   std::chrono::milliseconds seal_interval = DEFAULT_SEAL_INTERVAL);
+    ~SegmentedSearchServer();
+
+    SegmentedSearchServer(const SegmentedSearchServer&) = delete;
+    SegmentedSearchServer& operator=(const SegmentedSearchServer&) = delete;
+
+    // The document becomes searchable once its buffer is sealed, at most
+    // seal_interval later
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+    // Seals the buffer right away
+    void Flush();
+    // Blocks until the background merges have brought the segment count within limits
+    void WaitForMerges();
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    // Number of searchable documents
+    int GetDocumentCount() const;
+    size_t GetSegmentCount() const;
+
+private:
+    // Documents removed from a sealed segment as of one snapshot. Never
+    // changes once published; each removal makes a new generation
+    struct SegmentRemovals {
+        explicit SegmentRemovals(const SearchServer& index);
+
+        // Indexed by internal id of the segment index: the number of the removal
+        // of the document, 0 while it is live. Shared by all generations, each of
+        // which only sees the removals numbered up to last_removal
+        std::shared_ptr<std::vector<std::atomic<uint64_t>>> removal_numbers;
+        uint64_t last_removal = 0;
+        int removed_count = 0;
+        // Indexed by term id of the segment index: removed documents with the
+        // term, not counting the recent removals
+        std::shared_ptr<const std::vector<int>> term_removed_counts;
+        // Term ids of the documents of the recent removals, sorted
+        std::vector<int> recent_term_ids;
+        int recent_removal_count = 0;
+
+        bool IsRemoved(int internal_id) const;
+        int GetTermRemovedCount(int term_id) const;
+    };
+
+    struct Segment {
+        std::shared_ptr<const SearchServer> index;
+        std::shared_ptr<const SegmentRemovals> removals;
+
+        bool Contains(int document_id) const;
+        int GetDocumentCount() const;
+        // Ids of the removed documents
+        std::set<int> GetRemovedIds() const;
+        // The same segment with one more live document removed
+        Segment Remove(int internal_id, uint64_t removal_number) const;
+    };
+    using Snapshot = std::vector<Segment>;
+
+    const std::vector<std::string> stop_words_;
+    const size_t buffer_capacity_;
+    const size_t max_segment_count_;
+    const std::chrono::milliseconds seal_interval_;
+    // Holds no documents; parses queries
+    const SearchServer query_parser_;
+
+    // Only ever accessed through std::atomic_load and std::atomic_store
+    std::shared_ptr<const Snapshot> snapshot_;
+    // Serializes writers, including the merge thread publishing its result
+    std::mutex write_mutex_;
+    std::unique_ptr<SearchServer> buffer_;
+    // Numbers removals from sealed segments; requires write_mutex_
+    uint64_t removal_count_ = 0;
+
+    std::mutex merge_mutex_;
+    std::condition_variable merge_condition_;
+    bool merge_requested_ = false;
+    bool merging_ = false;
+    bool stopping_ = false;
+    std::thread merge_thread_;
+
+    std::shared_ptr<const Snapshot> GetSnapshot() const;
+    // Requires write_mutex_
+    void SealBuffer();
+    void RequestMerge();
+    // Body of the background thread: seals the buffer every seal_interval_ and runs requested merges
+    void RunMerges();
+    // Rewrites a segment with too many removed documents or, failing that,
+    // merges the lightest pair of adjacent segments; false if neither is needed
+    bool MergeOnce();
+    bool NeedsPurge(const Segment& segment) const;
+
+    // Share of removed documents past which a segment is rewritten without them
+    static constexpr double MAX_REMOVED_SHARE = 0.25;
+    // Removals a generation keeps as recent before folding them into its term counts
+    static constexpr int MAX_RECENT_REMOVALS = 64;
+
+    // IDF of every plus word computed over all live documents of the snapshot
+    static std::vector<double> ComputeInverseDocumentFreqs(const Snapshot& snapshot, const SearchServer::Query& query);
+};
+
+
+template <typename StringContainer>
+SegmentedSearchServer::SegmentedSearchServer(const StringContainer& stop_words,
+                                             size_t buffer_capacity,
+                                             size_t max_segment_count,
+                                             std::chrono::milliseconds seal_interval)
+    : stop_words_(stop_words.begin(), stop_words.end())
+    , buffer_capacity_(std::max<size_t>(buffer_capacity, 1))
+    , max_segment_count_(std::max<size_t>(max_segment_count, 1))
+    , seal_interval_(seal_interval)
+    , query_parser_(stop_words_)
+    , snapshot_(std::make_shared<const Snapshot>())
+    , buffer_(std::make_unique<SearchServer>(stop_words_))
+    , merge_thread_([this] { RunMerges(); }) {
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(std::string_view raw_query,
+                                                              DocumentPredicate document_predicate,
+                                                              size_t max_result_count) const {
+    const auto snapshot = GetSnapshot();
+    const auto query = query_parser_.ParseQuery(raw_query);
+    const auto inverse_document_freqs = ComputeInverseDocumentFreqs(*snapshot, query);
+
+    std::vector<TopDocumentsCollector> collectors(snapshot->size(), TopDocumentsCollector(max_result_count));
+    std::vector<size_t> indexes(snapshot->size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t index) {
+        const Segment& segment = (*snapshot)[index];
+        const bool has_removed = segment.removals->removed_count > 0;
+        segment.index->CollectTopDocuments(query, inverse_document_freqs,
+                                           [&](int document_id, DocumentStatus status, int rating) {
+            return (!has_removed || !segment.removals->IsRemoved(segment.index->FindInternalId(document_id)))
+                && document_predicate(document_id, status, rating);
+        }, collectors[index]);
+    });
+
+    TopDocumentsCollector collector(max_result_count);
+    for (TopDocumentsCollector& segment_collector : collectors) {
+        collector.Merge(std::move(segment_collector));
+    }
+    return collector.Release();
+}
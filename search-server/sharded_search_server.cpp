@@ -0,0 +1,83 @@
+#include "sharded_search_server.h"
+
+using namespace std;
+
+
+ShardedSearchServer::ShardedSearchServer(string_view stop_words_text, size_t shard_count)
+    : ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count) {
+}
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count)
+    : ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count) {
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    // Equal ids land on the same shard, which rejects duplicates itself
+    shards_[GetShardIndex(document_id)].AddDocument(document_id, document, status, ratings);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    shards_[GetShardIndex(document_id)].RemoveDocument(document_id);
+}
+
+void ShardedSearchServer::Compact() {
+    for_each(execution::par, shards_.begin(), shards_.end(), [](SearchServer& shard) {
+        shard.Compact();
+    });
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, size_t max_result_count) const {
+    return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
+        return document_status == status;
+    }, max_result_count);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+tuple<vector<string_view>, DocumentStatus> ShardedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    return shards_[GetShardIndex(document_id)].MatchDocument(raw_query, document_id);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const SearchServer& shard : shards_) {
+        document_count += shard.GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+const SearchServer& ShardedSearchServer::GetShard(size_t index) const {
+    return shards_.at(index);
+}
+
+void ShardedSearchServer::SetQueryEngine(QueryEngine engine) {
+    for (SearchServer& shard : shards_) {
+        shard.SetQueryEngine(engine);
+    }
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    // Fibonacci hashing spreads runs of consecutive ids over all shards
+    const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id)) * 0x9E3779B97F4A7C15ull;
+    return (hash >> 32) % shards_.size();
+}
+
+vector<double> ShardedSearchServer::ComputeInverseDocumentFreqs(const SearchServer::Query& query) const {
+    const int document_count = GetDocumentCount();
+    vector<double> inverse_document_freqs;
+    inverse_document_freqs.reserve(query.plus_words.size());
+    for (const string_view word : query.plus_words) {
+        int word_document_count = 0;
+        for (const SearchServer& shard : shards_) {
+            word_document_count += shard.GetWordDocumentCount(word);
+        }
+        inverse_document_freqs.push_back(word_document_count == 0 ? 0.0 : log(document_count * 1.0 / word_document_count));
+    }
+    return inverse_document_freqs;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <execution>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+#include "string_processing.h"
+#include "top_documents_collector.h"
+
+
+// Spreads documents over independent SearchServer shards by a hash of their id.
+// Queries run on all shards in parallel and the per-shard results are merged.
+// Words are weighted by corpus-wide IDF, so the ranking is the same as that
+// of a single SearchServer holding every document.
+class ShardedSearchServer {
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(const StringContainer& stop_words, size_t shard_count);
+    ShardedSearchServer(std::string_view stop_words_text, size_t shard_count);
+    ShardedSearchServer(const std::string& stop_words_text, size_t shard_count);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+    // Compacts the shards in parallel
+    void Compact();
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+                                           size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+    size_t GetShardCount() const;
+    const SearchServer& GetShard(size_t index) const;
+
+    void SetQueryEngine(QueryEngine engine);
+
+private:
+    // std::deque never relocates the shards, which are not copyable
+    std::deque<SearchServer> shards_;
+
+    size_t GetShardIndex(int document_id) const;
+    // IDF of every plus word computed over all shards
+    std::vector<double> ComputeInverseDocumentFreqs(const SearchServer::Query& query) const;
+};
+
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(const StringContainer& stop_words, size_t shard_count) {
+    if (shard_count == 0) {
+        throw std::invalid_argument("Shard count must be positive"s);
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words);
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query,
+                                                            DocumentPredicate document_predicate,
+                                                            size_t max_result_count) const {
+    // All shards share the stop words, so any of them can parse the query
+    const auto query = shards_.front().ParseQuery(raw_query);
+    const auto inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+
+    std::vector<TopDocumentsCollector> collectors(shards_.size(), TopDocumentsCollector(max_result_count));
+    std::vector<size_t> indexes(shards_.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t index) {
+        shards_[index].CollectTopDocuments(query, inverse_document_freqs, document_predicate, collectors[index]);
+    });
+
+    TopDocumentsCollector collector(max_result_count);
+    for (TopDocumentsCollector& shard_collector : collectors) {
+        collector.Merge(std::move(shard_collector));
+    }
+    return collector.Release();
+}
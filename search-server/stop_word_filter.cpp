@@ -0,0 +1,61 @@
+#include "stop_word_filter.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+bool StopWordFilter::Contains(string_view word) const {
+    if ((length_mask_ & GetLengthBit(word.size())) == 0) {
+        return false;
+    }
+    const unsigned char first_byte = static_cast<unsigned char>(word[0]);
+    if ((first_byte_mask_[first_byte / 64] & (uint64_t{1} << (first_byte % 64))) == 0) {
+        return false;
+    }
+    const uint64_t hash = Hash(word);
+    for (uint64_t index = hash & slot_mask_;; index = (index + 1) & slot_mask_) {
+        const Slot& slot = slots_[index];
+        if (slot.length == 0) {
+            return false;
+        }
+        if (slot.hash == hash && word == string_view(characters_.data() + slot.offset, slot.length)) {
+            return true;
+        }
+    }
+}
+
+size_t StopWordFilter::size() const {
+    return size_;
+}
+
+uint64_t StopWordFilter::Hash(string_view word) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (const char c : word) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t StopWordFilter::GetLengthBit(size_t length) {
+    return uint64_t{1} << min<size_t>(length, 63);
+}
+
+void StopWordFilter::Insert(string_view word) {
+    if (Contains(word)) {
+        return;
+    }
+    const uint64_t hash = Hash(word);
+    uint64_t index = hash & slot_mask_;
+    while (slots_[index].length != 0) {
+        index = (index + 1) & slot_mask_;
+    }
+    slots_[index] = {hash, static_cast<uint32_t>(characters_.size()), static_cast<uint32_t>(word.size())};
+    characters_ += word;
+    length_mask_ |= GetLengthBit(word.size());
+    const unsigned char first_byte = static_cast<unsigned char>(word[0]);
+    first_byte_mask_[first_byte / 64] |= uint64_t{1} << (first_byte % 64);
+    ++size_;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Immutable set of stop words tuned for membership tests. A bitmap of word
+// lengths and one of first bytes reject most words before hashing. The rest
+// probe a small open-addressing table that keeps the hashes, so a miss
+// rarely compares any bytes.
+class StopWordFilter {
+public:
+    StopWordFilter() = default;
+
+    template <typename StringContainer>
+    explicit StopWordFilter(const StringContainer& stop_words);
+
+    bool Contains(std::string_view word) const;
+
+    size_t size() const;
+
+private:
+    struct Slot {
+        uint64_t hash = 0;
+        uint32_t offset = 0;
+        // Zero marks an empty slot; stop words are never empty
+        uint32_t length = 0;
+    };
+
+    // Bit n is set if a stop word has length n; the last bit stands for all longer lengths
+    uint64_t length_mask_ = 0;
+    uint64_t first_byte_mask_[4] = {};
+    std::vector<Slot> slots_;
+    uint64_t slot_mask_ = 0;
+    std::string characters_;
+    size_t size_ = 0;
+
+    static uint64_t Hash(std::string_view word);
+    static uint64_t GetLengthBit(size_t length);
+    void Insert(std::string_view word);
+};
+
+
+template <typename StringContainer>
+StopWordFilter::StopWordFilter(const StringContainer& stop_words) {
+    size_t word_count = 0;
+    for (const std::string_view word : stop_words) {
+        word_count += !word.empty();
+    }
+    // At most half full, so probe sequences stay short
+    size_t slot_count = 4;
+    while (slot_count < word_count * 2) {
+        slot_count *= 2;
+    }
+    slots_.resize(slot_count);
+    slot_mask_ = slot_count - 1;
+    for (const std::string_view word : stop_words) {
+        if (!word.empty()) {
+            Insert(word);
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#include "string_arena.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+string_view StringArena::Store(string_view str) {
+    if (str.empty()) {
+        return {};
+    }
+    if (str.size() > remaining_) {
+        // Oversized strings get a chunk of their own and leave the current one in use
+        if (str.size() > CHUNK_SIZE / 4) {
+            char* data = AllocateChunk(str.size());
+            copy(str.begin(), str.end(), data);
+            return {data, str.size()};
+        }
+        position_ = AllocateChunk(CHUNK_SIZE);
+        remaining_ = CHUNK_SIZE;
+    }
+    char* data = position_;
+    copy(str.begin(), str.end(), data);
+    position_ += str.size();
+    remaining_ -= str.size();
+    return {data, str.size()};
+}
+
+size_t StringArena::GetMemoryUsage() const {
+    return memory_usage_;
+}
+
+char* StringArena::AllocateChunk(size_t size) {
+    chunks_.push_back(make_unique<char[]>(size));
+    memory_usage_ += size;
+    return chunks_.back().get();
+}
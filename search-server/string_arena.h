@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+
+// Bump allocator for strings that live as long as the arena. Bytes are
+// carved out of large chunks, so storing a string costs no allocation of
+// its own, and stored strings never move.
+class StringArena {
+public:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    // Returns a view of the stored copy
+    std::string_view Store(std::string_view str);
+
+    // Number of bytes allocated for chunks
+    size_t GetMemoryUsage() const;
+
+private:
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* position_ = nullptr;
+    size_t remaining_ = 0;
+    size_t memory_usage_ = 0;
+
+    char* AllocateChunk(size_t size);
+};
@@ -1,40 +1,90 @@
 #include "string_processing.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
 
+namespace {
+
+bool IsControlChar(char c) {
+    return static_cast<unsigned char>(c) < ' ';
+}
+
+}  // namespace
+
+
 vector<string_view> SplitIntoWords(string_view text) {
     vector<string_view> words;
-    while (true) {
-        auto space = text.find(' ', 0);
-        words.push_back(text.substr(0, space));
-        if (space == text.npos) {
-            break;
-        } else {
-            text.remove_prefix(space + 1);
+    ForEachWord(text, [&words](string_view word, bool) {
+        words.push_back(word);
+    });
+    return words;
+}
+
+bool ContainsControlChars(string_view text) {
+    const char* const end = text.data() + text.size();
+    for (const char* begin = text.data();; ++begin) {
+        bool is_valid = true;
+        begin = FindWordEnd(begin, end, is_valid);
+        if (!is_valid) {
+            return true;
+        }
+        if (begin == end) {
+            return false;
         }
     }
-    return words;
 }
 
-/*
-vector<string> SplitIntoWords(const string& text) {
-    vector<string> words;
-    string word;
-    for (const char c : text) {
-        if (c == ' ') {
-            if (!word.empty()) {
-                words.push_back(word);
-                word.clear();
+const char* FindWordEnd(const char* begin, const char* end, bool& is_valid) {
+    // A byte is a control character if max(byte, 31) == 31 in unsigned comparison
+#if defined(__AVX2__)
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    for (; end - begin >= 32; begin += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        const uint32_t space_mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, spaces)));
+        const uint32_t control_mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_max_epu8(bytes, last_control), last_control)));
+        if (space_mask != 0) {
+            const int position = __builtin_ctz(space_mask);
+            if ((control_mask & ((1u << position) - 1)) != 0) {
+                is_valid = false;
             }
-        } else {
-            word += c;
+            return begin + position;
+        }
+        if (control_mask != 0) {
+            is_valid = false;
         }
     }
-    if (!word.empty()) {
-        words.push_back(word);
+#elif defined(__SSE2__)
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i last_control = _mm_set1_epi8(' ' - 1);
+    for (; end - begin >= 16; begin += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        const uint32_t space_mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, spaces)));
+        const uint32_t control_mask = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_max_epu8(bytes, last_control), last_control)));
+        if (space_mask != 0) {
+            const int position = __builtin_ctz(space_mask);
+            if ((control_mask & ((1u << position) - 1)) != 0) {
+                is_valid = false;
+            }
+            return begin + position;
+        }
+        if (control_mask != 0) {
+            is_valid = false;
+        }
     }
-
-    return words;
+#endif
+    for (; begin != end && *begin != ' '; ++begin) {
+        if (IsControlChar(*begin)) {
+            is_valid = false;
+        }
+    }
+    return begin;
 }
-*/
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <set>
 #include <algorithm>
 #include <execution>
@@ -19,4 +20,30 @@ std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContain
     return non_empty_strings;
 }
 
+// Splits at every space, so consecutive spaces produce empty words
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
+
+// Whether the text has a byte in the range 0..31
+bool ContainsControlChars(std::string_view text);
+
+// Returns the end of the word starting at begin: the first space or end.
+// Clears is_valid if the word contains a control character.
+// Scans 16 or 32 bytes at a time where SSE2 or AVX2 is available
+const char* FindWordEnd(const char* begin, const char* end, bool& is_valid);
+
+// Calls func(word, is_valid) for every word SplitIntoWords would return, in
+// order, without allocating. is_valid is !ContainsControlChars(word)
+template <typename Func>
+void ForEachWord(std::string_view text, Func func) {
+    const char* begin = text.data();
+    const char* const end = begin + text.size();
+    while (true) {
+        bool is_valid = true;
+        const char* word_end = FindWordEnd(begin, end, is_valid);
+        func(std::string_view(begin, word_end - begin), is_valid);
+        if (word_end == end) {
+            break;
+        }
+        begin = word_end + 1;
+    }
+}
@@ -0,0 +1,49 @@
+#include "term_dictionary.h"
+
+using namespace std;
+
+
+int TermDictionary::Find(string_view term) const {
+    const auto it = term_to_id_.find(term);
+    if (it == term_to_id_.end()) {
+        return NO_TERM;
+    }
+    return it->second;
+}
+
+int TermDictionary::Insert(string_view term) {
+    const auto it = term_to_id_.find(term);
+    if (it != term_to_id_.end()) {
+        return it->second;
+    }
+    const int term_id = static_cast<int>(terms_.size());
+    const string_view stored = terms_.emplace_back(term_bytes_.Store(term));
+    term_to_id_.emplace(stored, term_id);
+    return term_id;
+}
+
+string_view TermDictionary::GetTerm(int term_id) const {
+    return terms_[term_id];
+}
+
+int TermDictionary::size() const {
+    return static_cast<int>(terms_.size());
+}
+
+size_t TermDictionary::GetMemoryUsage() const {
+    return term_bytes_.GetMemoryUsage();
+}
+
+TermDictionary TermDictionary::Load(IndexFileReader& reader) {
+    TermDictionary dictionary;
+    dictionary.terms_ = reader.ReadStrings();
+    dictionary.term_to_id_.reserve(dictionary.terms_.size());
+    for (int term_id = 0; term_id < static_cast<int>(dictionary.terms_.size()); ++term_id) {
+        dictionary.term_to_id_.emplace(dictionary.terms_[term_id], term_id);
+    }
+    return dictionary;
+}
+
+void TermDictionary::Save(IndexFileWriter& writer) const {
+    writer.WriteStrings(terms_);
+}
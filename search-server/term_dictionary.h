@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "index_file.h"
+#include "string_arena.h"
+
+
+// Interns index terms and gives each distinct term a dense integer id.
+// Lookups take std::string_view and never allocate. Term bytes are kept
+// in an arena, so interning a term does not allocate a string of its own.
+class TermDictionary {
+public:
+    static const int NO_TERM = -1;
+
+    // Returns NO_TERM if the term has never been inserted
+    int Find(std::string_view term) const;
+
+    // Returns the id of the term, interning it on first use
+    int Insert(std::string_view term);
+
+    // The returned view stays valid for the lifetime of the dictionary
+    std::string_view GetTerm(int term_id) const;
+
+    int size() const;
+
+    // Number of bytes used for the term strings
+    size_t GetMemoryUsage() const;
+
+    // The loaded terms point into the file, which must stay mapped while the dictionary is in use
+    static TermDictionary Load(IndexFileReader& reader);
+    void Save(IndexFileWriter& writer) const;
+
+private:
+    // Views into term_bytes_ or into a mapped index file
+    std::vector<std::string_view> terms_;
+    StringArena term_bytes_;
+    std::unordered_map<std::string_view, int> term_to_id_;
+};
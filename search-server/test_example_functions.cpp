@@ -1,5 +1,11 @@
 #include "test_example_functions.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "corpus_generator.h"
+
 using namespace std;
 
 void AddDocument(SearchServer& search_server, int document_id, string_view document, DocumentStatus status,
@@ -25,9 +31,11 @@ void FindTopDocuments(const SearchServer& search_server, string_view raw_query)
 void MatchDocuments(const SearchServer& search_server, string_view query) {
     try {
         cout << "Matching documents on query: "s << query << endl;
-        for (const int document_id : search_server) {
-            const auto [words, status] = search_server.MatchDocument(query, document_id);
-            PrintMatchDocumentResult(document_id, words, status);
+        MatchResults matches;
+        search_server.MatchDocuments(query, matches);
+        for (size_t i = 0; i < matches.size(); ++i) {
+            const auto [document_id, status, words] = matches[i];
+            PrintMatchDocumentResult(document_id, {words.begin(), words.end()}, status);
         }
 
     } catch (const invalid_argument& e) {
@@ -35,3 +43,96 @@ void MatchDocuments(const SearchServer& search_server, string_view query) {
     }
 }
 
+namespace {
+
+// Ties may be ordered differently, so only the relevances are compared
+bool HaveSameRelevances(const vector<Document>& lhs, const vector<Document>& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    vector<double> lhs_relevances;
+    vector<double> rhs_relevances;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        lhs_relevances.push_back(lhs[i].relevance);
+        rhs_relevances.push_back(rhs[i].relevance);
+    }
+    sort(lhs_relevances.begin(), lhs_relevances.end());
+    sort(rhs_relevances.begin(), rhs_relevances.end());
+    return equal(lhs_relevances.begin(), lhs_relevances.end(), rhs_relevances.begin(), [](double lhs, double rhs) {
+        return abs(lhs - rhs) < relevance_deviation;
+    });
+}
+
+}  // namespace
+
+bool TestQueryEnginesMatch(mt19937& generator) {
+    const vector<string> dictionary = GenerateDictionary(generator, 500, 8);
+    const ZipfDistribution distribution(dictionary.size(), 1.0);
+    SearchServer search_server(dictionary[0]);
+    uniform_int_distribution<int> ratings(-3, 3);
+    for (int document_id = 0; document_id < 3000; ++document_id) {
+        const auto status = static_cast<DocumentStatus>(generator() % 2);
+        search_server.AddDocument(document_id, GenerateQuery(generator, dictionary, distribution, 30), status,
+                                  {ratings(generator)});
+    }
+    // Removed documents keep their postings until the compaction, which comes halfway
+    for (int document_id = 0; document_id < 3000; document_id += 7) {
+        search_server.RemoveDocument(document_id);
+    }
+
+    bool same = true;
+    for (int i = 0; i < 400; ++i) {
+        if (i == 200) {
+            search_server.Compact();
+        }
+        const string query = GenerateQuery(generator, dictionary, distribution, 1 + i % 6, 0.2);
+        const size_t max_result_count = i % 3 == 0 ? 1 : i % 3 == 1 ? MAX_RESULT_DOCUMENT_COUNT : 50;
+        const auto status = static_cast<DocumentStatus>(i % 2);
+        search_server.SetQueryEngine(QueryEngine::EXHAUSTIVE);
+        const auto expected = search_server.FindTopDocuments(query, status, max_result_count);
+        search_server.SetQueryEngine(QueryEngine::BLOCK_MAX_WAND);
+        const auto documents = search_server.FindTopDocuments(query, status, max_result_count);
+        if (!HaveSameRelevances(documents, expected)) {
+            cout << "Query engines disagree on query: "s << query << endl;
+            same = false;
+        }
+    }
+    return same;
+}
+
+bool TestIndexRoundTrip(const SearchServer& search_server, const vector<string>& queries, const string& path) {
+    search_server.SaveIndex(path);
+    const SearchServer loaded_server = SearchServer::LoadIndex(path);
+    // The mapping stays valid after the file is removed
+    remove(path.c_str());
+
+    bool same = loaded_server.GetDocumentCount() == search_server.GetDocumentCount();
+    if (!same) {
+        cout << "Round trip changed the document count"s << endl;
+    }
+    for (const string& query : queries) {
+        const auto documents = search_server.FindTopDocuments(query);
+        const auto loaded_documents = loaded_server.FindTopDocuments(query);
+        if (!equal(documents.begin(), documents.end(), loaded_documents.begin(), loaded_documents.end(),
+                   [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+        })) {
+            cout << "Round trip changed the results of query: "s << query << endl;
+            same = false;
+        }
+        // About a hundred documents per query keep the check quick on a large index
+        const int step = max(search_server.GetDocumentCount() / 100, 1);
+        int position = 0;
+        for (const int document_id : search_server) {
+            if (position++ % step != 0) {
+                continue;
+            }
+            if (search_server.MatchDocument(query, document_id) != loaded_server.MatchDocument(query, document_id)) {
+                cout << "Round trip changed the match of document "s << document_id << " on query: "s << query << endl;
+                same = false;
+            }
+        }
+    }
+    return same;
+}
+
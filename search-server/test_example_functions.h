@@ -4,6 +4,7 @@
 #include <execution>
 #include <stdexcept>
 #include <deque>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -19,4 +20,14 @@ void FindTopDocuments(const SearchServer& search_server, std::string_view raw_qu
 
 void MatchDocuments(const SearchServer& search_server, std::string_view query);
 
+// Runs random queries against a random corpus with some documents removed and
+// checks that BLOCK_MAX_WAND finds documents as relevant as EXHAUSTIVE does.
+// Prints every difference and returns whether there were none
+bool TestQueryEnginesMatch(std::mt19937& generator);
+
+// Saves the index to path, loads it back and checks that both answer the queries
+// alike. Prints every difference and returns whether there were none
+bool TestIndexRoundTrip(const SearchServer& search_server, const std::vector<std::string>& queries,
+                        const std::string& path);
+
 
@@ -0,0 +1,71 @@
+#include "top_documents_collector.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (abs(lhs.relevance - rhs.relevance) < relevance_deviation) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+
+TopDocumentsCollector::TopDocumentsCollector(size_t max_count)
+    : max_count_(max_count) {
+    // A large max_count usually means "all results", so only the common case
+    // is reserved up front and the heap grows past it as needed
+    heap_.reserve(min(max_count, INITIAL_CAPACITY));
+}
+
+void TopDocumentsCollector::Add(const Document& document) {
+    if (heap_.size() < max_count_) {
+        heap_.push_back(document);
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    } else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocumentsCollector::Merge(TopDocumentsCollector&& other) {
+    for (const Document& document : other.heap_) {
+        Add(document);
+    }
+    other.heap_.clear();
+}
+
+bool TopDocumentsCollector::IsFull() const {
+    return heap_.size() >= max_count_;
+}
+
+size_t TopDocumentsCollector::GetMaxCount() const {
+    return max_count_;
+}
+
+size_t TopDocumentsCollector::GetCount() const {
+    return heap_.size();
+}
+
+const Document& TopDocumentsCollector::GetWorst() const {
+    return heap_.front();
+}
+
+vector<Document> TopDocumentsCollector::Release() {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    vector<Document> result;
+    result.swap(heap_);
+    return result;
+}
+
+size_t TopDocumentsCollector::ReleaseInto(Document* out) {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    copy(heap_.begin(), heap_.end(), out);
+    const size_t count = heap_.size();
+    heap_.clear();
+    return count;
+}
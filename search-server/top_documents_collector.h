@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "document.h"
+
+
+const double relevance_deviation = 1e-6;
+
+// Ranking order of search results: by relevance, equal relevance by rating
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+
+// Keeps the best max_count documents fed to it in a bounded min-heap, so
+// selecting the top of n matches costs O(n log max_count) instead of a full sort.
+class TopDocumentsCollector {
+public:
+    explicit TopDocumentsCollector(size_t max_count);
+
+    void Add(const Document& document);
+    // Moves the documents of other into this collector
+    void Merge(TopDocumentsCollector&& other);
+
+    bool IsFull() const;
+    size_t GetMaxCount() const;
+    // Number of documents collected so far
+    size_t GetCount() const;
+    // The document that would be evicted next. Requires a non-empty collector
+    const Document& GetWorst() const;
+
+    // Returns the collected documents ordered by IsMoreRelevant and empties the collector
+    std::vector<Document> Release();
+    // Same, but writes the documents to out, which needs room for GetCount()
+    // of them, and returns their number
+    size_t ReleaseInto(Document* out);
+
+private:
+    static constexpr size_t INITIAL_CAPACITY = 64;
+
+    size_t max_count_;
+    // Heap ordered by IsMoreRelevant, so the least relevant document is at the front
+    std::vector<Document> heap_;
+};